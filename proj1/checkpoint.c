@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "computer.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Checkpoints of a running computer.
+ *
+ *  A checkpoint file is a CheckpointHeader, the bitmaps of nonzero
+ *  words of the pages that had been allocated, in ascending order, the
+ *  numbers (addr>>12) of those pages, and then, starting on a 4 KiB
+ *  boundary, the contents of those pages one after another, all in host
+ *  byte order. The engines keep the bitmaps current between StepN()
+ *  calls, so they can be saved as they are. Since every page sits on a
+ *  page boundary in the file, LoadCheckpoint() maps the file
+ *  copy-on-write and points the page table straight into it: restoring
+ *  costs no reading or copying, and pages the run never touches again
+ *  never come off the disk.
+ */
+
+#define CKPT_MAGIC 0x434b504d	/* "MPKC" */
+#define CKPT_VERSION 3
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int layout;
+    unsigned int pc;
+    long long instrCount;
+    int registers [32];
+    int hi, lo;
+    unsigned int heapBreak;
+    int fullIsa;
+    Region regions [NUMSEGS];
+    unsigned int numPages;
+    unsigned int dataOffset;	/* where the first page starts */
+} CheckpointHeader;
+
+/*
+ *  Write the state of the computer, which must still be running, to
+ *  path. Returns -1 if the file can't be written.
+ */
+int SaveCheckpoint (Computer* mips, const char *path) {
+    static const char zeroes[4*PAGEWORDS];
+    CheckpointHeader h;
+    FILE *out;
+    unsigned int pad, bitmapBytes = PAGEWORDS/64 * sizeof(unsigned long long);
+    int k, n, ok;
+
+    memset (&h, 0, sizeof(h));
+    h.magic = CKPT_MAGIC;
+    h.version = CKPT_VERSION;
+    h.layout = mips->layout;
+    h.pc = mips->pc;
+    h.instrCount = mips->instrCount;
+    memcpy (h.registers, mips->registers, sizeof(h.registers));
+    h.hi = mips->hi;
+    h.lo = mips->lo;
+    h.heapBreak = mips->heapBreak;
+    h.fullIsa = mips->fullIsa;
+    memcpy (h.regions, mips->regions, sizeof(h.regions));
+    h.numPages = mips->numPages;
+    h.dataOffset = (sizeof(h) + (4 + bitmapBytes)*h.numPages + 4*PAGEWORDS-1)
+        / (4*PAGEWORDS) * 4*PAGEWORDS;
+
+    out = fopen (path, "wb");
+    if (out == NULL) {
+        return -1;
+    }
+    pad = h.dataOffset - sizeof(h) - (4 + bitmapBytes)*h.numPages;
+    ok = fwrite (&h, sizeof(h), 1, out) == 1;
+    for (k=0; ok && k<mips->numPages; k++) {
+        n = mips->pageList[k];
+        ok = fwrite (mips->pageDir[n >> 10]->nonzero[n & 1023], 1, bitmapBytes, out)
+            == bitmapBytes;
+    }
+    ok = ok && fwrite (mips->pageList, 4, h.numPages, out) == h.numPages
+        && fwrite (zeroes, 1, pad, out) == pad;
+    for (k=0; ok && k<mips->numPages; k++) {
+        n = mips->pageList[k];
+        ok = fwrite (mips->pageDir[n >> 10]->words[n & 1023], 4, PAGEWORDS, out) == PAGEWORDS;
+    }
+    if (fclose (out) != 0 || !ok) {
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ *  Make the computer what it was when the checkpoint at path was taken,
+ *  on the staged engine with nothing printed, like ClearComputer().
+ *  mips must not own any memory yet. Returns -1 if path isn't a
+ *  checkpoint that can be mapped: a short or misplaced page table, or
+ *  a page number that isn't a 32-bit address's, is refused before
+ *  anything is installed.
+ */
+int LoadCheckpoint (Computer* mips, const char *path) {
+    FILE *in;
+    CheckpointHeader h;
+    struct stat st;
+    unsigned int *pages;
+    unsigned long long *bits;
+    char *image;
+    unsigned long long bitmapBytes = PAGEWORDS/64 * sizeof(unsigned long long);
+    int k;
+
+    in = fopen (path, "rb");
+    if (in == NULL) {
+        return -1;
+    }
+    if (fread (&h, sizeof(h), 1, in) != 1 || h.magic != CKPT_MAGIC
+        || h.version != CKPT_VERSION || fstat (fileno (in), &st) != 0
+        || h.dataOffset % (4*PAGEWORDS) != 0
+        || h.dataOffset < sizeof(h) + (4 + bitmapBytes)*h.numPages
+        || (unsigned long long) h.dataOffset + 4ULL*PAGEWORDS*h.numPages
+           > (unsigned long long) st.st_size) {
+        fclose (in);
+        return -1;
+    }
+    image = mmap (NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+                  fileno (in), 0);
+    fclose (in);
+    if (image == MAP_FAILED) {
+        return -1;
+    }
+    bits = (unsigned long long *) (image + sizeof(h));
+    pages = (unsigned int *) (bits + h.numPages*(PAGEWORDS/64));
+    for (k=0; k<h.numPages; k++) {
+        if (pages[k] >= 1 << 20) {
+            munmap (image, st.st_size);
+            return -1;
+        }
+    }
+
+    ClearComputer (mips, h.layout);
+    AddMapping (mips, image, st.st_size);
+    memcpy (mips->regions, h.regions, sizeof(h.regions));
+    memcpy (mips->registers, h.registers, sizeof(h.registers));
+    mips->hi = h.hi;
+    mips->lo = h.lo;
+    mips->heapBreak = h.heapBreak;
+    mips->fullIsa = h.fullIsa;
+    mips->pc = h.pc;
+    mips->instrCount = h.instrCount;
+    for (k=0; k<h.numPages; k++) {
+        InstallPage (mips, pages[k] << 12,
+                     (int *) (image + h.dataOffset + 4*PAGEWORDS*k),
+                     bits + k*(PAGEWORDS/64));
+    }
+    if (PredecodeText (mips) < 0) {
+        FreeMemory (mips);
+        return -1;
+    }
+    return 0;
+}
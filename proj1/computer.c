@@ -1,63 +1,254 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "computer.h"
+#include "trace.h"
+#include "pipeline.h"
+#include "ooo.h"
+#include "ilp.h"
+#include "loop.h"
+#include "predict.h"
+#include "profile.h"
+#include "statehash.h"
+#include "undo.h"
+#include "debug.h"
 #undef mips			/* gcc already has a def for mips */
 
 unsigned int endianSwap(unsigned int);
 
-void PrintInfo (int changedReg, int changedMem);
-unsigned int Fetch (int);
-void Decode (unsigned int, DecodedInstr*, RegVals*);
-int Execute (DecodedInstr*, RegVals*);
-int Mem(DecodedInstr*, int, int *);
-void RegWrite(DecodedInstr*, int, int *);
-void UpdatePC(DecodedInstr*, int);
-void PrintInstruction (DecodedInstr*);
+int FetchDecoded (Computer*, DecodedInstr*);
+void ReadRegs (Computer*, DecodedInstr*, RegVals*);
+void RunStages (Computer*, DecodedInstr*, int *, int *);
+void RunQuiet (Computer*);
+int LoadProgram (Computer*, FILE*);
+int Execute (Computer*, DecodedInstr*, RegVals*);
+int Mem(Computer*, DecodedInstr*, int, int *);
+void RegWrite(Computer*, DecodedInstr*, int, int *);
+void UpdatePC(Computer*, DecodedInstr*, RegVals*);
+void PrintException (Computer*);
 
-/*Globally accessible Computer variable*/
-Computer mips;
-RegVals rVals;
+/*
+ *  Initialize the given computer with the stack pointer set to the
+ *  top of the stack (for the course layout, the end of data memory),
+ *  the remaining registers initialized to zero, the pc at the start of
+ *  the code section, and the instructions read from the given file.
+ *  The other arguments govern how the program interacts with the user;
+ *  the computer starts out on the staged engine, printing a trace.
+ *  Returns -1 if the program is too big.
+ *
+ *  A Computer holds all of the simulator's state, so any number of them
+ *  can run side by side, one per thread.
+ */
+int InitComputer (Computer* mips, FILE* filein, Layout layout,
+  int printingRegisters, int printingMemory, int debugging, int interactive) {
+    ClearComputer (mips, layout);
+    if (LoadProgram (mips, filein) < 0 || PredecodeText (mips) < 0) {
+        FreeMemory (mips);
+        return -1;
+    }
+
+    mips->printingRegisters = printingRegisters;
+    mips->printingMemory = printingMemory;
+    mips->interactive = interactive;
+    mips->debugging = debugging;
+    return 0;
+}
 
 /*
- *  Return an initialized computer with the stack pointer set to the
- *  address of the end of data memory, the remaining registers initialized
- *  to zero, and the instructions read from the given file.
- *  The other arguments govern how the program interacts with the user.
+ *  Decode the whole text segment once up front; the run loop
+ *  dispatches from mips->decoded instead of decoding every step.
+ *  Returns -1 if there's no memory for it.
  */
-void InitComputer (FILE* filein, int printingRegisters, int printingMemory,
-  int debugging, int interactive) {
+int PredecodeText (Computer* mips) {
     int k;
-    unsigned int instr;
 
-    /* Initialize registers and memory */
+    mips->textWords = (mips->regions[SEG_TEXT].limit - mips->regions[SEG_TEXT].base) / 4;
+    mips->decoded = malloc (mips->textWords * sizeof(DecodedInstr));
+    if (mips->decoded == NULL) {
+        return -1;
+    }
+    for (k=0; k<mips->textWords; k++) {
+        Predecode (mips, mips->regions[SEG_TEXT].base + 4*k);
+    }
+    return 0;
+}
+
+/*
+ *  Give the computer empty memory laid out as asked, and registers and
+ *  the pc as they are when a program starts.
+ */
+void ClearComputer (Computer* mips, Layout layout) {
+    int k;
 
+    InitMemory (mips, layout);
     for (k=0; k<32; k++) {
-        mips.registers[k] = 0;
+        mips->registers[k] = 0;
+    }
+    mips->hi = mips->lo = 0;
+    mips->heapBreak = mips->regions[SEG_HEAP].base;
+    if (layout == LAYOUT_SPIM) {
+        mips->registers[28] = 0x10008000;	/* $gp, as SPIM sets it */
+        mips->registers[29] = 0x7fffeffc;
+    } else {
+        /* stack pointer - Initialize to highest address of data segment */
+        mips->registers[29] = mips->regions[SEG_DATA].limit;
     }
-    
-    /* stack pointer - Initialize to highest address of data segment */
-    mips.registers[29] = 0x00400000 + (MAXNUMINSTRS+MAXNUMDATA)*4;
 
-    for (k=0; k<MAXNUMINSTRS+MAXNUMDATA; k++) {
-        mips.memory[k] = 0;
+    /* Initialize the PC to the start of the code section */
+    mips->pc = mips->regions[SEG_TEXT].base;
+
+    mips->printingRegisters = 0;
+    mips->printingMemory = 0;
+    mips->interactive = 0;
+    mips->debugging = 0;
+    mips->engine = STAGED;
+    mips->fullIsa = 0;
+    mips->quiet = 0;
+    mips->selfLoops = 1;
+    mips->trace = NULL;
+    mips->jit = NULL;
+    mips->pipeline = NULL;
+    mips->ooo = NULL;
+    mips->ilp = NULL;
+    mips->loops = NULL;
+    mips->console = NULL;
+    mips->predictors = NULL;
+    mips->profile = NULL;
+    mips->hashes = NULL;
+    mips->undo = NULL;
+    mips->breaks = NULL;
+    mips->watches = NULL;
+    mips->instrCount = 0;
+    mips->stopAt = LONG_MAX;
+    mips->maxInsns = LONG_MAX;
+    mips->halted = RUNNING;
+}
+
+/*
+ *  Make to an independent copy of from, which must not be mid-run: the
+ *  same memory, registers, pc, instruction count and options, but with
+ *  no trace, models or JIT code of its own. to must not own any memory.
+ *  Returns -1 if there's no memory for it.
+ */
+int CopyComputer (Computer* to, Computer* from) {
+    int k, n, *page;
+
+    ClearComputer (to, from->layout);
+    memcpy (to->regions, from->regions, sizeof(to->regions));
+    for (k=0; k<from->numPages; k++) {
+        n = from->pageList[k];
+        page = AllocPage (to, (unsigned int) n << 12);
+        memcpy (page, from->pageDir[n >> 10]->words[n & 1023], 4*PAGEWORDS);
+        memcpy (to->pageDir[n >> 10]->nonzero[n & 1023],
+                from->pageDir[n >> 10]->nonzero[n & 1023],
+                PAGEWORDS/64 * sizeof(unsigned long long));
+    }
+    to->textWords = from->textWords;
+    to->decoded = malloc (to->textWords * sizeof(DecodedInstr));
+    if (to->decoded == NULL) {
+        FreeMemory (to);
+        return -1;
     }
+    memcpy (to->decoded, from->decoded, to->textWords * sizeof(DecodedInstr));
+
+    memcpy (to->registers, from->registers, sizeof(to->registers));
+    to->hi = from->hi;
+    to->lo = from->lo;
+    to->heapBreak = from->heapBreak;
+    to->fullIsa = from->fullIsa;
+    to->pc = from->pc;
+    to->printingRegisters = from->printingRegisters;
+    to->printingMemory = from->printingMemory;
+    to->interactive = from->interactive;
+    to->debugging = from->debugging;
+    to->engine = from->engine;
+    to->quiet = from->quiet;
+    to->selfLoops = from->selfLoops;
+    to->instrCount = from->instrCount;
+    to->halted = from->halted;
+    to->haltAddr = from->haltAddr;
+    return 0;
+}
 
-    k = 0;
+/*
+ *  Copy the program into the text region, growing the region to fit it
+ *  in the SPIM layout. The file is mapped rather than read when it can
+ *  be. Returns -1 if the program doesn't fit.
+ *
+ *  A dump holds little-endian words, so on a little-endian host its
+ *  words are already in host order: every whole page of the file is
+ *  then used as a text page as it is, copy-on-write like a checkpoint's,
+ *  and only the part page at the end is copied. Otherwise each word is
+ *  swapped on the way in.
+ */
+int LoadProgram (Computer* mips, FILE* filein) {
+    Region *text = &mips->regions[SEG_TEXT];
+    unsigned int *image = MAP_FAILED, instr;
+    unsigned int maxWords, n = 0, k = 0;
+    struct stat st;
+
+    if (mips->layout == LAYOUT_SPIM) {
+        maxWords = (mips->regions[SEG_DATA].base - text->base) / 4;
+    } else {
+        maxWords = MAXNUMINSTRS;
+    }
+
+    if (fstat (fileno (filein), &st) == 0 && S_ISREG (st.st_mode)
+        && st.st_size >= 4) {
+        if (st.st_size / 4 > maxWords) {
+            return -1;
+        }
+        image = mmap (NULL, st.st_size, PROT_READ|PROT_WRITE, MAP_PRIVATE,
+                      fileno (filein), 0);
+    }
+    if (image != MAP_FAILED) {
+        n = st.st_size / 4;
+        if (mips->layout == LAYOUT_SPIM) {
+            text->limit = text->base + (n + PAGEWORDS-1) / PAGEWORDS * 4*PAGEWORDS;
+        }
+        if (ntohl (endianSwap (1)) == 1 && n >= PAGEWORDS) {
+            AddMapping (mips, image, st.st_size);
+            for (k=0; k+PAGEWORDS <= n; k+=PAGEWORDS) {
+                InstallPage (mips, text->base + 4*k, (int *) image + k, NULL);
+            }
+            ScanMemory (mips);
+            for (; k<n; k++) {
+                WriteWord (mips, text->base + 4*k, image[k]);
+            }
+            return 0;
+        }
+        for (k=0; k<n; k++) {
+            /*swap to big endian, convert to host byte order. Ignore this.*/
+            WriteWord (mips, text->base + 4*k, ntohl(endianSwap(image[k])));
+        }
+        munmap (image, st.st_size);
+        return 0;
+    }
+
+    /* A pipe or the like: read it a word at a time */
     while (fread(&instr, 4, 1, filein)) {
-	/*swap to big endian, convert to host byte order. Ignore this.*/
-        mips.memory[k] = ntohl(endianSwap(instr));
-        k++;
-        if (k>MAXNUMINSTRS) {
-            fprintf (stderr, "Program too big.\n");
-            exit (1);
+        if (n == maxWords) {
+            return -1;
         }
+        if (text->base + 4*n >= text->limit) {
+            text->limit += 4*PAGEWORDS;
+        }
+        WriteWord (mips, text->base + 4*n, ntohl(endianSwap(instr)));
+        n++;
     }
+    return 0;
+}
 
-    mips.printingRegisters = printingRegisters;
-    mips.printingMemory = printingMemory;
-    mips.interactive = interactive;
-    mips.debugging = debugging;
+/* Release anything an engine allocated for the computer. */
+void FreeComputer (Computer* mips) {
+    FreeJit (mips);
+    FreeConsole (mips);
+    FreeDebug (mips);
+    FreeMemory (mips);
 }
 
 unsigned int endianSwap(unsigned int i) {
@@ -65,69 +256,427 @@ unsigned int endianSwap(unsigned int i) {
 }
 
 /*
- *  Run the simulation.
+ *  Interactive commands for going backwards: "rs [n]" undoes the last n
+ *  instructions (1 if n isn't given), "rc" everything the undo log
+ *  remembers, or back to the last breakpoint passed.
+ */
+static void Rewind (Computer* mips, char *cmd) {
+    long n = cmd[1] == 's' ? 1 : LONG_MAX, k;
+
+    if (mips->undo == NULL) {
+        printf ("Not recording; can't go back.\n");
+        return;
+    }
+    if (cmd[1] == 's' && atol (cmd + 2) > 0) {
+        n = atol (cmd + 2);
+    }
+    for (k=0; k<n && UndoStep (mips->undo, mips); k++) {
+        if (n == LONG_MAX && IsBreakpoint (mips, mips->pc)) {
+            k++;
+            break;
+        }
+    }
+    printf ("Back %ld instructions, to instruction %ld: pc = %8.8x\n",
+            k, mips->instrCount, mips->pc);
+    if (k < n && cmd[1] == 's') {
+        printf ("That is as far back as the undo log goes.\n");
+    }
+}
+
+/*
+ *  Interactive commands for running ahead: "c" or "continue" runs until
+ *  a breakpoint, a watchpoint or the end of the program, "run n" at most
+ *  n instructions. They go at StepN() speed on the staged engine, the
+ *  one that checks breakpoints and watchpoints, and only the stop is
+ *  reported.
+ */
+static void Continue (Computer* mips, long n) {
+    Engine engine = mips->engine;
+    unsigned int addr;
+    int old, new;
+    long ran;
+
+    mips->engine = STAGED;
+    ran = StepN (mips, n);
+    mips->engine = engine;
+    if (TakeWatchHit (mips, &addr, &old, &new)) {
+        printf ("Watchpoint at %8.8x: %8.8x -> %8.8x, written by the instruction at %8.8x\n",
+                addr, old, new, mips->pc - 4);
+        printf ("Ran %ld instructions, pc = %8.8x\n", ran, mips->pc);
+    } else if (mips->halted == HALT_UNSUPPORTED) {
+        printf ("Unsupported instruction at %8.8x: %8.8x\n",
+                mips->pc, Fetch (mips, mips->pc));
+    } else if (mips->halted) {
+        PrintException (mips);
+    } else if (ran < n) {
+        printf ("Breakpoint at %8.8x after %ld instructions\n", mips->pc, ran);
+    } else {
+        printf ("Ran %ld instructions, pc = %8.8x\n", ran, mips->pc);
+    }
+}
+
+/*
+ *  Interactive commands for stops: "b" or "break" and "clear" set and
+ *  remove a breakpoint on the instruction at a text address, "watch" and
+ *  "unwatch" a watchpoint on the word holding a data address. Addresses
+ *  are in C syntax, so usually hex with 0x. Returns 0 if cmd isn't one
+ *  of them.
  */
-void Simulate () {
+static int SetStop (Computer* mips, char *cmd) {
+    char name[16], *end;
+    unsigned int addr;
+    int on;
+
+    if (sscanf (cmd, "%15s", name) != 1) {
+        return 0;
+    }
+    on = strcmp (name, "b") == 0 || strcmp (name, "break") == 0 || strcmp (name, "watch") == 0;
+    if (!on && strcmp (name, "clear") != 0 && strcmp (name, "unwatch") != 0) {
+        return 0;
+    }
+    cmd += strspn (cmd, " \t");
+    cmd += strlen (name);
+    addr = strtoul (cmd, &end, 0);
+    if (end == cmd) {
+        printf ("%s needs an address.\n", name);
+    } else if (name[0] == 'b' || name[0] == 'c') {
+        if (SetBreakpoint (mips, addr, on) < 0) {
+            printf ("No instruction at %8.8x.\n", addr);
+        } else {
+            printf ("Breakpoint %s at %8.8x\n", on ? "set" : "cleared", addr);
+        }
+    } else {
+        if (SetWatchpoint (mips, addr & ~3, on) < 0) {
+            printf ("No memory at %8.8x.\n", addr);
+        } else {
+            printf ("Watchpoint %s on the word at %8.8x\n", on ? "set" : "cleared", addr & ~3);
+        }
+    }
+    return 1;
+}
+
+/*
+ *  Run the simulation. In interactive mode each line of input runs
+ *  one more instruction; "q" quits, see Rewind() for going back and
+ *  Continue() and SetStop() for running to a breakpoint or watchpoint.
+ *  The prompt stays up after the program stops, so it can be rewound.
+ *  Otherwise the run also stops after mips->maxInsns instructions.
+ */
+void Simulate (Computer* mips) {
     char s[40];  /* used for handling interactive input */
-    unsigned int instr;
-    int changedReg=-1, changedMem=-1, val;
+    unsigned int instr, addr;
+    int changedReg=-1, changedMem=-1, old, new;
     DecodedInstr d;
-    
-    /* Initialize the PC to the start of the code section */
-    mips.pc = 0x00400000;
+
+    /* Resumed or stepped by the caller past where the program stopped */
+    if (mips->halted != RUNNING) {
+        PrintSummary (mips);
+        return;
+    }
+
+    /*
+     * The other engines, and quiet mode, run the program without the
+     * per-instruction trace; interactive mode always steps through
+     * the stages below.
+     */
+    if ((mips->engine != STAGED || mips->quiet) && !mips->interactive) {
+        StepN (mips, mips->maxInsns - mips->instrCount);
+        if (mips->halted == RUNNING && mips->instrCount >= mips->maxInsns) {
+            mips->halted = HALT_LIMIT;
+        }
+        FlushConsole (mips);
+        PrintSummary (mips);
+        return;
+    }
+
     while (1) {
-        if (mips.interactive) {
+        if (mips->interactive) {
             printf ("> ");
-            fgets (s,sizeof(s),stdin);
-            if (s[0] == 'q') {
+            if (fgets (s,sizeof(s),stdin) == NULL || s[0] == 'q') {
                 return;
             }
+            if (s[0] == 'r' && (s[1] == 's' || s[1] == 'c')) {
+                Rewind (mips, s);
+                continue;
+            }
+            if (SetStop (mips, s)) {
+                continue;
+            }
+            if (mips->halted) {
+                printf ("The program has stopped; rs or rc to go back, q to quit.\n");
+                continue;
+            }
+            if (strncmp (s, "run", 3) == 0) {
+                Continue (mips, atol (s + 3) > 0 ? atol (s + 3) : 1);
+                continue;
+            }
+            if (strcmp (s, "c\n") == 0 || strcmp (s, "continue\n") == 0) {
+                Continue (mips, LONG_MAX);
+                continue;
+            }
+        } else if (mips->instrCount >= mips->maxInsns) {
+            mips->halted = HALT_LIMIT;
+            PrintException (mips);
+            return;
         }
 
-        /* Fetch instr at mips.pc, returning it in instr */
-        instr = Fetch (mips.pc);
+        /* Fetch and decode the instr at mips->pc, putting it in d */
+        if (!FetchDecoded (mips, &d)) {
+            PrintException (mips);
+            if (mips->interactive) {
+                continue;
+            }
+            return;
+        }
+        instr = Fetch (mips, mips->pc);
        // printf("instr \t %d\n", instr);
 
 
-        printf ("Executing instruction at %8.8x: %8.8x\n", mips.pc, instr);
-
-        /* 
-	 * Decode instr, putting decoded instr in d
-	 * Note that we reuse the d struct for each instruction.
-	 */
-        Decode (instr, &d, &rVals);
+        printf ("Executing instruction at %8.8x: %8.8x\n", mips->pc, instr);
 
         /*Print decoded instruction*/
         PrintInstruction(&d);
+        if (!IsSupported (&d)) {
+            mips->halted = HALT_UNSUPPORTED;
+            if (mips->interactive) {
+                continue;
+            }
+            return;
+        }
+
+        RunStages (mips, &d, &changedReg, &changedMem);
+        if (mips->halted == HALT_MEMORY || mips->halted == HALT_OVERFLOW) {
+            PrintException (mips);
+            if (mips->interactive) {
+                continue;
+            }
+            return;
+        }
+
+        PrintInfo (mips, changedReg, changedMem);
+        if (TakeWatchHit (mips, &addr, &old, &new)) {
+            /* a step stops anyway, and PrintInfo() showed the store */
+            mips->stopAt = LONG_MAX;
+        }
+        if (mips->halted) {
+            /* it ran, and showed there is nothing new left to run */
+            PrintException (mips);
+            if (mips->interactive) {
+                continue;
+            }
+            return;
+        }
+    }
+}
+
+/*
+ *  Run at most n more instructions on the computer's engine, without
+ *  the per-instruction trace, and return how many ran. Fewer than n
+ *  means the program stopped; mips->halted says why. A binary trace,
+ *  if there is one, records every instruction as usual.
+ */
+long StepN (Computer* mips, long n) {
+    long start = mips->instrCount;
+
+    if (mips->halted != RUNNING || n <= 0) {
+        return 0;
+    }
+    mips->stopAt = n > LONG_MAX - start ? LONG_MAX : start + n;
+    if (mips->fullIsa) {
+        /* the other engines only know the course subset */
+        RunQuiet (mips);
+    } else if (mips->engine == JIT) {
+        RunJit (mips);
+    } else if (mips->engine == THREADED) {
+        RunThreaded (mips);
+    } else {
+        RunQuiet (mips);
+    }
+    mips->stopAt = LONG_MAX;
+    if (mips->engine != STAGED && !mips->fullIsa) {
+        /* their sw handlers store straight to memory */
+        ScanMemory (mips);
+    }
+    return mips->instrCount - start;
+}
 
-        /* 
-	 * Perform computation needed to execute d, returning computed value 
-	 * in val 
-	 */
-        val = Execute(&d, &rVals);
+/* Describe why a computer stopped, for reports. */
+const char *HaltName (HaltReason reason) {
+    switch (reason) {
+        case HALT_UNSUPPORTED:
+            return "unsupported instruction";
+        case HALT_MEMORY:
+            return "memory access exception";
+        case HALT_OVERFLOW:
+            return "arithmetic overflow";
+        case HALT_LIMIT:
+            return "instruction limit";
+        case HALT_LOOP:
+            return "stuck in a loop";
+        case HALT_EXIT:
+            return "exit";
+        default:
+            return "running";
+    }
+}
 
-	UpdatePC(&d,val);
+/*
+ *  Put the decoded instruction at mips->pc in d. Text segment
+ *  instructions come from the pre-decoded image; anything executed out
+ *  of data memory is decoded on the spot. Either way d is a private
+ *  copy, so a sw that overwrites the instruction being executed can't
+ *  change it mid-flight. Returns 0, with mips->halted set, if mips->pc
+ *  is outside of simulated memory: instruction fetch is subject to the
+ *  same bounds as lw/sw.
+ */
+int FetchDecoded ( Computer* mips, DecodedInstr* d) {
+    if (!IsMapped (mips, mips->pc)) {
+        mips->halted = HALT_MEMORY;
+        mips->haltAddr = mips->pc;
+        return 0;
+    }
+    if (IsText (mips, mips->pc)) {
+        *d = mips->decoded[(mips->pc - mips->regions[SEG_TEXT].base)/4];
+    } else {
+        DecodeAs (Fetch (mips, mips->pc), mips->pc, d, mips->fullIsa);
+    }
+    return 1;
+}
+
+/*
+ *  Take d, the instruction at mips->pc, through the remaining stages.
+ *  If Execute() or Mem() raises an exception, mips->pc is left at d
+ *  and nothing is written back. An exit syscall finishes like any
+ *  other instruction.
+ */
+void RunStages ( Computer* mips, DecodedInstr* d, int *changedReg, int *changedMem) {
+    int pc = mips->pc, val, addr;
+    RegVals rVals;
+
+    ReadRegs (mips, d, &rVals);
+    if (mips->undo != NULL) {
+        UndoBefore (mips->undo, mips, d, &rVals);
+    }
+
+    /* 
+     * Perform computation needed to execute d, returning computed value 
+     * in val 
+     */
+    val = Execute(mips, d, &rVals);
+    addr = val; //for loads and stores
 
-        /* 
-	 * Perform memory load or store. Place the
-	 * address of any updated memory in *changedMem, 
-	 * otherwise put -1 in *changedMem. 
-	 * Return any memory value that is read, otherwise return -1.
-         */
-        val = Mem(&d, val, &changedMem);
+    UpdatePC(mips, d, &rVals);
 
-        /* 
-	 * Write back to register. If the instruction modified a register--
-	 * (including jal, which modifies $ra) --
-         * put the index of the modified register in *changedReg,
-         * otherwise put -1 in *changedReg.
-         */
-        RegWrite(&d, val, &changedReg);
+    /* 
+     * Perform memory load or store. Place the
+     * address of any updated memory in *changedMem, 
+     * otherwise put -1 in *changedMem. 
+     * Return any memory value that is read, otherwise return -1.
+     */
+    val = Mem(mips, d, val, changedMem);
+    if (mips->halted && mips->halted != HALT_EXIT) {
+        mips->pc = pc;
+        *changedReg = -1;
+        return;
+    }
 
-        PrintInfo (changedReg, changedMem);
+    /* 
+     * Write back to register. If the instruction modified a register--
+     * (including jal, which modifies $ra) --
+     * put the index of the modified register in *changedReg,
+     * otherwise put -1 in *changedReg.
+     */
+    RegWrite(mips, d, val, changedReg);
+    mips->instrCount++;
+    if (mips->pipeline != NULL) {
+        PipeStep (mips->pipeline, d, pc, mips->pc);
+    }
+    if (mips->ooo != NULL) {
+        OooStep (mips->ooo, d, addr);
+    }
+    if (mips->ilp != NULL) {
+        IlpStep (mips->ilp, d, pc, addr);
+    }
+    if (mips->predictors != NULL) {
+        PredictStep (mips->predictors, d, pc, mips->pc);
+    }
+    if (mips->profile != NULL) {
+        ProfileStep (mips->profile, d, pc, mips->pc);
+    }
+    if (mips->hashes != NULL) {
+        HashStep (mips->hashes, mips, pc, *changedReg, *changedMem);
+    }
+    if (mips->undo != NULL) {
+        UndoAfter (mips->undo, mips, *changedReg, *changedMem);
+    }
+    if (mips->loops != NULL && !mips->halted) {
+        LoopStep (mips->loops, mips, pc, *changedReg, *changedMem);
     }
 }
 
+/*
+ *  Run the stages without printing, until the program stops or
+ *  reaches mips->stopAt instructions. If there is a binary trace, each
+ *  instruction is recorded in it, and so is the reason the run stopped.
+ */
+void RunQuiet (Computer* mips) {
+    int changedReg, changedMem, pc, inMemory, running;
+    unsigned int instr = 0, value;
+    long start = mips->instrCount;
+    TraceKind kind = TRACE_STEP;
+
+    while (mips->instrCount < mips->stopAt) {
+        pc = mips->pc;
+        if (mips->breaks != NULL && mips->instrCount != start && IsBreakpoint (mips, pc)) {
+            break;		/* the one we start on was already reported */
+        }
+        inMemory = IsMapped (mips, pc);
+        if (mips->trace != NULL && inMemory) {
+            instr = Fetch (mips, pc); /* before a sw can overwrite it */
+        }
+        running = Step (mips, &changedReg, &changedMem);
+        if (mips->trace != NULL) {
+            value = 0;
+            if (changedReg != -1) {
+                value = mips->registers[changedReg];
+            } else if (changedMem != -1) {
+                value = Fetch (mips, changedMem);
+            }
+            if (!running && mips->halted != HALT_LOOP && mips->halted != HALT_EXIT) {
+                /* (those two stop the run once the instruction is done) */
+                kind = mips->halted == HALT_UNSUPPORTED ? TRACE_UNSUPPORTED
+                    : inMemory ? TRACE_MEMORY : TRACE_FETCH;
+                changedMem = mips->haltAddr;
+            }
+            TraceStep (mips->trace, pc, instr, changedReg, value, changedMem, kind);
+        }
+        if (!running) {
+            break;
+        }
+    }
+}
+
+/*
+ *  Execute the instruction at mips->pc without printing anything.
+ *  changedReg and changedMem are set as for PrintInfo(). Returns 0 once
+ *  the program has stopped; mips->halted says why.
+ */
+int Step ( Computer* mips, int *changedReg, int *changedMem) {
+    DecodedInstr d;
+
+    *changedReg = -1;
+    *changedMem = -1;
+    if (!FetchDecoded (mips, &d)) {
+        return 0;
+    }
+    if (!IsSupported (&d)) {
+        mips->halted = HALT_UNSUPPORTED;
+        return 0;
+    }
+    RunStages (mips, &d, changedReg, changedMem);
+    return !mips->halted;
+}
+
 /*
  *  Print relevant information about the state of the computer.
  *  changedReg is the index of the register changed by the instruction
@@ -138,450 +687,290 @@ void Simulate () {
  *  registers or just the one that changed, and whether to print
  *  all the nonzero memory or just the memory location that changed.
  */
-void PrintInfo ( int changedReg, int changedMem) {
-    int k, addr;
-    printf ("New pc = %8.8x\n", mips.pc);
-    if (!mips.printingRegisters && changedReg == -1) {
+void PrintInfo ( Computer* mips, int changedReg, int changedMem) {
+    int k;
+    printf ("New pc = %8.8x\n", mips->pc);
+    if (!mips->printingRegisters && changedReg == -1) {
         printf ("No register was updated.\n");
-    } else if (!mips.printingRegisters) {
+    } else if (!mips->printingRegisters) {
         printf ("Updated r%2.2d to %8.8x\n",
-        changedReg, mips.registers[changedReg]);
+        changedReg, mips->registers[changedReg]);
     } else {
         for (k=0; k<32; k++) {
-            printf ("r%2.2d: %8.8x  ", k, mips.registers[k]);
+            printf ("r%2.2d: %8.8x  ", k, mips->registers[k]);
             if ((k+1)%4 == 0) {
                 printf ("\n");
             }
         }
+        if (mips->fullIsa) {
+            printf ("hi: %8.8x  lo: %8.8x\n", mips->hi, mips->lo);
+        }
     }
-    if (!mips.printingMemory && changedMem == -1) {
+    if (!mips->printingMemory && changedMem == -1) {
         printf ("No memory location was updated.\n");
-    } else if (!mips.printingMemory) {
+    } else if (!mips->printingMemory) {
         printf ("Updated memory at address %8.8x to %8.8x\n",
-        changedMem, Fetch (changedMem));
+        changedMem, Fetch (mips, changedMem));
     } else {
-        printf ("Nonzero memory\n");
-        printf ("ADDR	  CONTENTS\n");
-        for (addr = 0x00400000+4*MAXNUMINSTRS;
-             addr < 0x00400000+4*(MAXNUMINSTRS+MAXNUMDATA);
-             addr = addr+4) {
-            if (Fetch (addr) != 0) {
-                printf ("%8.8x  %8.8x\n", addr, Fetch (addr));
-            }
+        PrintNonzero (mips);
+    }
+}
+
+/* Report the exception, or whatever else, that stopped the program. */
+void PrintException (Computer* mips) {
+    if (mips->halted == HALT_OVERFLOW) {
+        printf ("Arithmetic Overflow Exception at 0x%.8x\n", mips->pc);
+    } else if (mips->halted == HALT_LIMIT) {
+        printf ("Instruction limit reached at 0x%.8x\n", mips->pc);
+    } else if (mips->halted == HALT_LOOP) {
+        printf ("Stuck in a loop at 0x%.8x\n", mips->pc);
+    } else if (mips->halted == HALT_EXIT) {
+        printf ("Exit syscall at 0x%.8x\n", mips->haltAddr);
+    } else {
+        printf ("Memory Access Exception at 0x%.8x: address 0x%.8x\n",
+        mips->pc, mips->haltAddr);
+    }
+}
+
+/*
+ *  Print the state of the computer at the end of a run that didn't
+ *  trace every instruction: why it stopped, how far it got, all the
+ *  registers, and all the nonzero memory if -m was given.
+ */
+void PrintSummary (Computer* mips) {
+    int k;
+
+    if (mips->halted == HALT_UNSUPPORTED) {
+        printf ("Unsupported instruction at %8.8x: %8.8x\n",
+        mips->pc, Fetch (mips, mips->pc));
+    } else if (mips->halted) {
+        PrintException (mips);
+    }
+    printf ("Executed %ld instructions\n", mips->instrCount);
+    printf ("Final pc = %8.8x\n", mips->pc);
+    for (k=0; k<32; k++) {
+        printf ("r%2.2d: %8.8x  ", k, mips->registers[k]);
+        if ((k+1)%4 == 0) {
+            printf ("\n");
         }
     }
+    if (mips->fullIsa) {
+        printf ("hi: %8.8x  lo: %8.8x\n", mips->hi, mips->lo);
+    }
+    if (mips->printingMemory) {
+        PrintNonzero (mips);
+    }
 }
 
 /*
  *  Return the contents of memory at the given address. Simulates
  *  instruction fetch. 
  */
-unsigned int Fetch ( int addr) {
+unsigned int Fetch ( Computer* mips, int addr) {
     //printf("fetching boi: %d\n", addr);
 
-    return mips.memory[(addr-0x00400000)/4];
-}
+    int value = 0;
 
-/*
-    addu Rdest, Rsrc1, Rsrc2 : 0x00
-    addiu Rdest, Rsrc1, imm : 0x09
-    subu Rdest, Rsrc1, Rsrc2: 0x00
-    sll Rdest, Rsrc, shamt : 0x00
-    srl Rdest, Rsrc, shamt : 0x00
-    and Rdest, Rsrc1, Rsrc2 : 0x00
-    andi Rdest, Rsrc, imm : 0X0C = 12
-    or Rdest, Rsrc1, Rsrc2 : 0x00
-    ori Rdest, Rsrc, imm : 0X0D = 13
-    lui Rdest, imm : 0x0F = 15
-    slt Rdest, Rsrc1, Rsrc2 : 0x00
-    beq Rsrc1, Rsrc2, raddr : 0x04
-    bne Rsrc1, Rsrc2, raddr : 0x05
-    j address : 0x02
-    jal address : 0x03
-    jr Rsrc : 0x00
-    lw Rdest, offset: 0x23 =35
-    sw Rsrc, offset :x0x2B = 43
- */
+    ReadWord (mips, addr, &value);
+    return value;
+}
 
 //https://en.wikibooks.org/wiki/MIPS_Assembly/Instruction_Formats#R_Instructions
 //mips sheet: https://inst.eecs.berkeley.edu/~cs61c/resources/MIPS_Green_Sheet.pdf
 //j instruction: https://www.d.umn.edu/~gshute/mips/jtype.xhtml
-/* Decode instr, returning decoded instruction. */
-void Decode ( unsigned int instr, DecodedInstr* d, RegVals* rVals) {
-    /* Your code goes here */
-
-
-    //printf("instr \t %d\n", instr);
+/*
+ * Decode instr, the word stored at address addr, returning decoded
+ * instruction. Immediates are sign-extended where the instruction calls
+ * for it and branch targets are resolved against addr, so the result
+ * depends only on the word and where it lives. d->info is the
+ * instruction's entry in the tables of isa.c, for the full instruction
+ * set if fullIsa and the course subset otherwise.
+ */
+void DecodeAs ( unsigned int instr, int addr, DecodedInstr* d, int fullIsa) {
+    const InstrInfo *info = LookupInstr (instr, fullIsa);
+    int imm = (short) (instr & 0xffff);
 
-    
     d -> op = instr >> 26;
+    d -> info = info;
     if (d -> op == 0) { //r type via opcode
         d -> type = R;
-        
-        unsigned int rs =instr <<6;
-        rs = rs >>27;
-        d -> regs.r.rs =rs;
-        rVals -> R_rs =mips.registers[rs];
-       // printf("rs \t %d\n", rs);
-        
-        unsigned int rt = instr<<11;
-        rt =rt >>27;
-        d -> regs.r.rt =rt;
-        rVals -> R_rt =mips.registers[rt];
-        //printf("rt\t %d\n", rt);
-        
-        unsigned int rd = instr<<16;
-        rd =rd >>27;
-        d -> regs.r.rd =rd;
-        rVals-> R_rd =mips.registers[rd];
-        //printf("rd \t %d\n", rd);
-        
-        unsigned int shamt = instr<<21;
-        shamt =shamt >>27;
-        d -> regs.r.shamt =shamt;
-        
-        unsigned int funct = instr<<26;
-        funct = funct >>26;
-        d -> regs.r.funct=funct;
-    }else{
-        if(d -> op ==3 || d -> op ==2){ //j type via opcode
-            d-> type =J;
-            unsigned int target = instr<<6;
-            target =target >>4;
-            d -> regs.j.target =target;
-            
-        }else{ //i type via opcode
-            d -> type =I;
-            
-            unsigned int rs =instr<<6;
-            rs =rs >>27;
-            d-> regs.i.rs =rs;
-            rVals -> R_rs = mips.registers[rs];
-            
-            unsigned int rt = instr <<11;
-            rt =rt>>27;
-            d -> regs.i.rt=rt;
-            rVals ->R_rt= mips.registers[rt];
-            
-            unsigned int unsignedImmd;
-            int signedImmd;
-            
-            switch(d->op){
-                case 4:
-                    //unsignedImmd
-                    unsignedImmd =instr<<16;
-                    unsignedImmd =unsignedImmd>>16;
-                    unsignedImmd =(unsignedImmd *4) +4 +mips.pc;
-                    d -> regs.i.addr_or_immed =unsignedImmd;
-                    break;
-                    
-                case 5:
-                    //unsignedImmd
-                    unsignedImmd =instr<<16;
-                    unsignedImmd =unsignedImmd>>16;
-                    unsignedImmd =(unsignedImmd *4) +4 +mips.pc;
-                    d -> regs.i.addr_or_immed =unsignedImmd;
-                    break;
-
-                case 9:
-                    //signedImmd
-                    signedImmd = instr <<16;
-                    signedImmd = signedImmd >> 16;
-                    d -> regs.i.addr_or_immed = signedImmd;
-                    break;
-
-                case 12:
-                    //unsignedImmd
-                    unsignedImmd =instr <<16;
-                    unsignedImmd =unsignedImmd >>16;
-                    d -> regs.i.addr_or_immed =unsignedImmd;
-                    break;
-                    
-                case 13:
-                    //unsignedImmd
-                    unsignedImmd =instr <<16;
-                    unsignedImmd =unsignedImmd >>16;
-                    d -> regs.i.addr_or_immed =unsignedImmd;
-                    break;
-                    
-                case 15:
-                    //signedImmd
-                    signedImmd = instr <<16;
-                    signedImmd = signedImmd >> 16;
-                    d -> regs.i.addr_or_immed = signedImmd;
-                    break;
-
-                case 35:
-                    //signedImmd
-                    signedImmd = instr <<16;
-                    signedImmd = signedImmd >> 16;
-                    d -> regs.i.addr_or_immed = signedImmd;
-                    break;
-
-                case 43:
-                    //signedImmd
-                    signedImmd = instr <<16;
-                    signedImmd = signedImmd >> 16;
-                    d -> regs.i.addr_or_immed = signedImmd;
-                    break;
-            }
+        d -> regs.r.rs = (instr >> 21) & 31;
+        d -> regs.r.rt = (instr >> 16) & 31;
+        d -> regs.r.rd = (instr >> 11) & 31;
+        d -> regs.r.shamt = (instr >> 6) & 31;
+        d -> regs.r.funct = instr & 63;
+    } else if (d -> op == 2 || d -> op == 3) { //j type via opcode
+        d -> type = J;
+        d -> regs.j.target = (instr << 6) >> 4;
+    } else { //i type via opcode
+        d -> type = I;
+        d -> regs.i.rs = (instr >> 21) & 31;
+        d -> regs.i.rt = (instr >> 16) & 31;
+        if (info != NULL && info -> imm == IMM_ZERO) {
+            imm = instr & 0xffff;
+        } else if (info != NULL && info -> imm == IMM_BRANCH) {
+            //word offset from the next instruction
+            imm = imm*4 + 4 + addr;
+        }
+        d -> regs.i.addr_or_immed = imm;
+    }
+}
+
+/* Decode as the course simulator does. */
+void Decode ( unsigned int instr, int addr, DecodedInstr* d) {
+    DecodeAs (instr, addr, d, 0);
+}
+
+/*
+ *  Decode the word at addr into the pre-decoded text image. Called for
+ *  every text word at load time and again whenever sw overwrites one.
+ */
+void Predecode ( Computer* mips, int addr) {
+    if (IsText (mips, addr) && mips->decoded != NULL) {
+        DecodeAs (Fetch (mips, addr), addr,
+                  &mips->decoded[(addr - mips->regions[SEG_TEXT].base)/4], mips->fullIsa);
+    }
+}
+
+/*
+ *  Switch the computer between the course subset and all of the MIPS-I
+ *  integer instructions, redecoding the text to match. Only the staged
+ *  engine runs the full set.
+ */
+void SetFullIsa ( Computer* mips, int fullIsa) {
+    int k;
+
+    mips->fullIsa = fullIsa;
+    for (k=0; k<mips->textWords; k++) {
+        Predecode (mips, mips->regions[SEG_TEXT].base + 4*k);
+    }
+}
+
+/* Read the register operands named by d into rVals. */
+void ReadRegs ( Computer* mips, DecodedInstr* d, RegVals* rVals) {
+    if (d -> type == R) {
+        rVals -> R_rs = mips->registers[d -> regs.r.rs];
+        rVals -> R_rt = mips->registers[d -> regs.r.rt];
+        rVals -> R_rd = mips->registers[d -> regs.r.rd];
+    } else if (d -> type == I) {
+        rVals -> R_rs = mips->registers[d -> regs.i.rs];
+        rVals -> R_rt = mips->registers[d -> regs.i.rt];
+    }
+}
+
+
+/*
+ *  Put the disassembled version of the given instruction in buf, which
+ *  holds size chars. Returns 0, with buf empty, for an instruction it
+ *  doesn't know. The operands are the entry's syntax with D, S and T
+ *  replaced by register numbers, H by the shift amount, I and X by the
+ *  immediate in decimal and hex, and A by the target address.
+ */
+int Disassemble ( DecodedInstr* d, char *buf, int size) {
+    const char *s;
+    int n;
+
+    buf[0] = '\0';
+    if (d -> info == NULL || d -> info -> name == NULL) {
+        return 0;
+    }
+    n = snprintf (buf, size, "%s\t", d -> info -> name);
+    for (s = d -> info -> syntax; *s != '\0' && n < size-1; s++) {
+        switch (*s) {
+            case 'D':
+                n += snprintf (buf+n, size-n, "%d", d -> regs.r.rd);
+                break;
+            case 'S':
+                n += snprintf (buf+n, size-n, "%d", d -> regs.r.rs);
+                break;
+            case 'T':
+                n += snprintf (buf+n, size-n, "%d", d -> regs.r.rt);
+                break;
+            case 'H':
+                n += snprintf (buf+n, size-n, "%d", d -> regs.r.shamt);
+                break;
+            case 'I':
+                n += snprintf (buf+n, size-n, "%d", d -> regs.i.addr_or_immed);
+                break;
+            case 'X':
+                n += snprintf (buf+n, size-n, "%x", d -> regs.i.addr_or_immed);
+                break;
+            case 'A':
+                n += snprintf (buf+n, size-n, "%08x", d -> type == J ? d -> regs.j.target
+                                                                    : d -> regs.i.addr_or_immed);
+                break;
+            default:
+                buf[n++] = *s;
+                buf[n] = '\0';
         }
     }
+    return 1;
 }
 
 /*
  *  Print the disassembled version of the given instruction
- *  followed by a newline.
+ *  followed by a newline; ones Disassemble() doesn't know print nothing.
  */
 void PrintInstruction ( DecodedInstr* d) {
-    /* Your code goes here */
-    int rrs = d->regs.r.rs;
-    int rrt = d->regs.r.rt;
-    int rd = d->regs.r.rd;
-    
-    int target = d->regs.j.target;
-
-    int irs = d->regs.i.rs;
-    int irt = d->regs.i.rt;
-    int imm = d->regs.i.addr_or_immed;
-    
-    switch (d -> op) {
-        case 0:
-            //r instruction based of function since all opcodes are 0
-            
-            /* funct decimal
-             addu 33
-             subu 35
-             sll 0
-             srl 2
-             and 36
-             or 37
-             slt 42
-             jr 8
-             */
-            
-            switch(d -> regs.r.funct) {
-                case 0:
-                    printf("sll\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    break;
-                case 2:
-                    printf("srl\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    break;
-                case 8:
-                    printf("jr\t$%d\n", rrs);
-                    break;
-                case 33 :
-                    printf("addu\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    break;
-                case 35 :
-                    printf("subu\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    break;
-                case 36:
-                    printf("and\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    break;
-                case 37:
-                    printf("or\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    break;
-                case 42:
-                    printf("slt\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    break;
-               
-            }
-            break;
-            
-        case 2:
-            //j instruction
-            printf("j\t0x%08x\n", target);
-            break;
-        case 3:
-            //j instruction
-            printf("jal\t0x%08x\n", target);
-            break;
-        case 4:
-            //i instruction
-            printf("beq\t$%d, $%d, 0x%08x\n", irs, irt, imm);
-            break;
-        case 5:
-            //i instruction
-            printf("bne\t$%d, $%d, 0x%08x\n", irs, irt, imm);
-            break;
-        case 9:
-            //i instruction
-            printf("addiu\t$%d, $%d, %d\n", irt, irs, imm);
-            break;
-        case 12:
-            //i instruction
-            printf("andi\t$%d, $%d, 0x%x\n", irt, irs, imm);
-            break;
-        case 13:
-            //i instruction
-            printf("ori\t$%d, $%d, 0x%x\n", irt, irs, imm);
-            break;
-        case 15:
-            //i instruction
-            printf("lui\t$%d, 0x$%x\n", irs, imm);
-            break;
-        case 35:
-            //i instruction
-            printf("lw\t$%d, %d($%d)\n", irt, imm, irs);
-            break;
-        case 43:
-            //i instruction
-            printf("sw\t$%d, %d($%d)\n", irt, imm, irs);
-            break;
+    char buf[40];
 
+    if (Disassemble (d, buf, sizeof(buf))) {
+        printf ("%s\n", buf);
     }
-    
-    /* funct decimal
-     addu 33
-     subu 35
-     sll 0
-     srl 2
-     and 36
-     or 37
-     slt 42
-     jr 8
-     */
-    if (d-> op == 0 || d-> op == 2 || d-> op == 3 || d-> op == 4 || d-> op == 5 || d-> op == 9 || d-> op == 12 || d-> op == 13 || d-> op == 15 || d-> op == 35 || d-> op == 43) {
-       /* if(d->regs.r.funct == 33 || d->regs.r.funct == 35 || d->regs.r.funct == 0 || d->regs.r.funct == 2 || d->regs.r.funct == 36 || d->regs.r.funct == 37 || d->regs.r.funct == 42 || d->regs.r.funct == 8){
-            
-        }*/
-        
-        //supported instr
-    }else{
-        exit(0);
-    }
-}
-
-/* Perform computation needed to execute d, returning computed value */
-int Execute ( DecodedInstr* d, RegVals* rVals) {
-    /* Your code goes here */
-    unsigned int rrs = rVals->R_rs;
-    unsigned int rrt = rVals->R_rt;
-    unsigned int rd = rVals -> R_rd;
-    
-   // int target = d->regs.j.target;
-    
-    int irs = rVals->R_rs;
-    int irt = rVals-> R_rt;
-    int imm = d->regs.i.addr_or_immed;
-    
-    int result =0;
-    
-    switch (d -> op) {
-        case 0:
-            //r instruction based of function since all opcodes are 0
-            
-            /* funct decimal
-             addu 33
-             subu 35
-             sll 0
-             srl 2
-             and 36
-             or 37
-             slt 42
-             jr 8
-             */
-            
-            switch(d->regs.r.funct) {
-                case 0:
-                    //printf("sll\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    rd = rrt << d-> regs.r.shamt;
-                    break;
-                case 2:
-                    //printf("srl\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    rd = rrt >> d->regs.r.shamt;
-                    break;
-                case 8:
-                    //printf("jr\t$%d\n", rrs);
-                    return rrs;
-                case 33 :
-                    //printf("addu\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    rd = rrs + rrt;
-                    break;
-                case 35 :
-                    //printf("subu\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    rd = rrs - rrt;
-                    break;
-                case 36:
-                    //printf("and\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    rd = rrs & rrt;
-                    break;
-                case 37:
-                    //printf("or\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    rd = rrs | rrt;
-                    break;
-                case 42:
-                    //printf("slt\t$%d, $%d, $%d\n", rd, rrs, rrt);
-                    if (rrs < rrt) {
-                        rd = 1;
-                    }else {
-                        rd = 0;
-                    }
-                    break;
-            }
-            rVals->R_rd = rd;
-            return rd;
-        case 2:
-            //j instruction
-            //printf("j\t0x%08x\n", target);
-            return 0;
-            break;
-        case 3:
-            //j instruction
-            //printf("jal\t0x%08x\n", target);
-            return (mips.pc + 4);
-            break;
-        case 4:
-            //i instruction
-            //printf("beq\t$%d, $%d, 0x%08x\n", irs, irt, imm);
-            result = irs - irt;
-            break;
-        case 5:
-            //i instruction
-            //printf("bne\t$%d, $%d, 0x%08x\n", irs, irt, imm);
-            result = irs - irt;
-            break;
-        case 9:
-            //i instruction
-            //printf("addiu\t$%d, $%d, %d\n", irt, irs, imm);
-            irt = imm + irs;
-            result = irt;
-            break;
-        case 12:
-            //i instruction
-            //printf("andi\t$%d, $%d, 0x%x\n", irt, irs, imm);
-            irt= irs & imm;
-            result = irt;
-            break;
-        case 13:
-            //i instruction
-            //printf("ori\t$%d, $%d, 0x%x\n", irt, irs, imm);
-            irt = irs| imm;
-            result = irt;
-            break;
-        case 15:
-            //i instruction
-            //printf("lui\t$%d, 0x$%x\n", irs, imm);
-            irt = imm << 16;
-            result = irt;
-            break;
-        case 35:
-            //i instruction
-            //printf("lw\t$%d, %d($%d)\n", irt, imm, irs);
-            irt = irs + imm;
-            result = irt;
-            //printf("lw reg: %d\n", result);
-            break;
-        case 43:
-            //i instruction
-            //printf("sw\t$%d, %d($%d)\n", irt, imm, irs);
-            result = irs + imm;
-            //printf("sw reg: %d\n", result);
-            break;
-            
+}
+
+/*
+ *  Return whether d is one of the instructions this simulator
+ *  implements. Running into anything else ends the simulation.
+ */
+int IsSupported ( DecodedInstr* d) {
+    return d -> info != NULL;
+}
+
+/*
+ *  Put the registers the supported instruction d reads in srcs and
+ *  return how many there are. A store's data register counts.
+ */
+int SourceRegs ( DecodedInstr* d, int srcs[2]) {
+    int n = 0;
+
+    if (d -> info -> reads & READS_RS) {
+        srcs[n++] = d -> regs.r.rs;
+    }
+    if (d -> info -> reads & READS_RT) {
+        srcs[n++] = d -> regs.r.rt;
     }
-  return result;
+    return n;
+}
+
+/* The register the supported instruction d writes, or -1 if none */
+int DestReg ( DecodedInstr* d) {
+    switch (d -> info -> wb) {
+        case W_RD:
+            return d -> regs.r.rd;
+        case W_RT:
+            return d -> regs.i.rt;
+        case W_R31:
+            return 31;
+        case W_V0:
+            return 2;
+        default:
+            return -1;
+    }
+}
+
+/*
+ *  Perform computation needed to execute d, returning computed value:
+ *  the result for the ALU, the address for loads and stores and the
+ *  return address for jal and the like. mult, div and the moves to HI
+ *  and LO set those here; add, addi and sub set mips->halted if they
+ *  overflow.
+ */
+int Execute ( Computer* mips, DecodedInstr* d, RegVals* rVals) {
+    if (d -> info -> exec == NULL) {
+        return 0;
+    }
+    return d -> info -> exec (mips, d, rVals);
 }
 
 /* 
@@ -589,48 +978,22 @@ int Execute ( DecodedInstr* d, RegVals* rVals) {
  * instructions other than branches and jumps, for example, the PC
  * increments by 4 (which we have provided).
  */
-void UpdatePC ( DecodedInstr* d, int val) {
-    /* Your code goes here */
-    //val is current val of mips.pc
-    /*
-     instructions that have branches and jumps
-        bne, j, jal, beq, jr (r type)
-     */
-    
-    int target = d -> regs.j.target;
-    int imm = d -> regs.i.addr_or_immed;
-    int funct = d -> regs.r.funct;
-    
-    switch (d -> op) {
-        case 0: //jr  PC=R[rs]
-            if(funct == 8){
-                mips.pc = val;
-            }else{
-                mips.pc+=4;
-            }
-            break;
-        case 2: //j PC=JumpAddr
-            mips.pc = target;
+void UpdatePC ( Computer* mips, DecodedInstr* d, RegVals* rVals) {
+    switch (d -> info -> next) {
+        case PC_JUMP: //PC=JumpAddr
+            mips->pc = d -> regs.j.target;
             break;
-        case 3: //jal PC=JumpAddr
-            mips.pc = target;
+        case PC_JUMPREG: //PC=R[rs]
+            mips->pc = rVals -> R_rs;
             break;
-        case 4: //beq  PC=PC+4+BranchAddr (add pc to imm value)
-            if (val == 0) {
-                mips.pc = imm;
-            }else{
-                mips.pc+=4;
+        case PC_BRANCH: //PC=PC+4+BranchAddr, already resolved by Decode()
+            if (d -> info -> cond (rVals -> R_rs, rVals -> R_rt)) {
+                mips->pc = d -> regs.i.addr_or_immed;
+                break;
             }
-            break;
-        case 5: //bne  PC=PC+4+BranchAddr
-            if (val != 0) {
-                mips.pc = imm;
-            }else{
-                mips.pc+=4;
-            }
-            break;
+            /* fall through */
         default:
-            mips.pc+=4;
+            mips->pc+=4;
     }
 }
 
@@ -639,118 +1002,91 @@ void UpdatePC ( DecodedInstr* d, int val) {
  * in *changedMem, otherwise put -1 in *changedMem. Return any memory value 
  * that is read, otherwise return -1. 
  *
- * Remember that we're mapping MIPS addresses to indices in the mips.memory 
- * array. mips.memory[0] corresponds with address 0x00400000, mips.memory[1] 
- * with address 0x00400004, and so forth.
+ * Addresses go through the page table in memory.c; anything outside
+ * the computer's regions, or not aligned to the size of the access, is
+ * an exception. Byte and halfword stores, and swl and swr, rewrite the
+ * word holding them, and that word is what *changedMem names.
  *
  */
-int Mem( DecodedInstr* d, int val, int *changedMem) {
-    /* Your code goes here */
-    
-    //4194304 decimal to 0x00400000
-    //4210687 decimal to 0x00403fff
-
-    if (d -> op != 43 && d -> op != 35) {
-        *changedMem =-1;
+int Mem( Computer* mips, DecodedInstr* d, int val, int *changedMem) {
+    MemKind kind = d -> info -> mem;
+    unsigned int addr = val, word, old, rt, shift, align;
+
+    *changedMem =-1;
+    if (kind == M_NONE) {
         return val;
-        
-    }else{
-    
-        //sw :update value in memory so we gotta update and then store the correct one in a register
-        // so we dont want to update the registers just update the memory
-        //add to increase location of memory
-    
-        //lw: doesnt store anything so we dont update anything just gets value from memory
-    
-        //printf("Val : %d\n", val);
-
-        if (val < 4194304 || val > 4210687 || val % 4 != 0) { //outta bounds
-            printf("Memory Access Exception at 0x%.8x: address 0x%.8x\n", mips.pc - 4, val);
-            exit(0);
-        }else{
-            *changedMem =-1;
-
-            switch (d -> op) {
-                case 35: //lw R[rt] = M[R[rs]+SignExtImm]
-                    //printf("fetching boi: %d\n", Fetch(val));
-                    
-                    //sum of base + addr => index
-                    return Fetch(val);
-                
-                case 43: //sw M[R[rs]+SignExtImm] = R[rt]
-                    *changedMem =val;
-                    //printf("changed val boi: %d\n", val);
-
-                    mips.memory[(val - 4194304)/4] = mips.registers [d-> regs.i.rt]; //i type -> rt
-                    return 0;
-
-                default:
-                    return val;
-            }
-        }
     }
+
+    align = kind == M_LW || kind == M_SW ? 4
+        : kind == M_LH || kind == M_LHU || kind == M_SH ? 2 : 1;
+    if (addr % align != 0 || !IsMapped(mips, addr & ~3)) { //outta bounds
+        //the caller reports it against the instruction's own pc
+        mips->halted = HALT_MEMORY;
+        mips->haltAddr = val;
+        return 0;
+    }
+
+    old = word = Fetch(mips, addr & ~3);
+    shift = 8 * (addr & 3);
+    rt = mips->registers [d-> regs.i.rt];
+    switch (kind) {
+        case M_LW: //R[rt] = M[R[rs]+SignExtImm]
+            return word;
+        case M_LB:
+            return (signed char) (word >> shift);
+        case M_LBU:
+            return (word >> shift) & 0xff;
+        case M_LH:
+            return (short) (word >> shift);
+        case M_LHU:
+            return (word >> shift) & 0xffff;
+        case M_LWL: //bytes up to addr, into the top of rt
+            return shift == 24 ? word : (word << (24 - shift)) | (rt & (0xffffffffu >> (shift + 8)));
+        case M_LWR: //bytes from addr on, into the bottom of rt
+            return (word >> shift) | (rt & ~(0xffffffffu >> shift));
+        case M_SW: //M[R[rs]+SignExtImm] = R[rt]
+            word = rt;
+            break;
+        case M_SB:
+            word = (word & ~(0xffu << shift)) | ((rt & 0xff) << shift);
+            break;
+        case M_SH:
+            word = (word & ~(0xffffu << shift)) | ((rt & 0xffff) << shift);
+            break;
+        case M_SWL:
+            word = (word & ~(0xffffffffu >> (24 - shift))) | (rt >> (24 - shift));
+            break;
+        case M_SWR:
+            word = (word & ~(0xffffffffu << shift)) | (rt << shift);
+            break;
+        default:
+            return val;
+    }
+    *changedMem = addr & ~3;
+    if (mips->watches != NULL && word != old && IsWatched(mips->watches, addr & ~3)) {
+        WatchHit(mips, addr & ~3, old, word); //stop once this instruction is done
+    }
+    if (mips->loops != NULL) {
+        LoopStore(mips->loops, addr & ~3, old, word);
+    }
+    WriteWord(mips, addr & ~3, word);
+    Predecode(mips, addr & ~3); //keep the decoded text image coherent
+    return 0;
 }
 
 /* 
  * Write back to register. If the instruction modified a register--
  * (including jal, which modifies $ra) --
  * put the index of the modified register in *changedReg,
- * otherwise put -1 in *changedReg.
+ * otherwise put -1 in *changedReg. In the course subset $0 is a
+ * register like any other; with the full instruction set it stays 0.
  */
-void RegWrite( DecodedInstr* d, int val, int *changedReg) {
-    /* Your code goes here */
-    
-    /* funct decimal
-     addu 33
-     subu 35
-     sll 0
-     srl 2
-     and 36
-     or 37
-     slt 42
-     jr 8
-     */
-    
-    *changedReg = -1;
-
-    if(d->type == R){
-        //r types, that aren't jumps
-        if(d->regs.r.funct == 33  || d->regs.r.funct == 0 ||
-           d->regs.r.funct == 2 || d->regs.r.funct == 36 || d->regs.r.funct == 37 ||
-           d->regs.r.funct == 42){
-            *changedReg = d->regs.r.rd;
-            mips.registers[*changedReg] = val;
-            return;
-        }
-        //jr
+void RegWrite( Computer* mips, DecodedInstr* d, int val, int *changedReg) {
+    *changedReg = DestReg (d);
+    if (*changedReg == 0 && mips->fullIsa) {
         *changedReg = -1;
-        return;
-
     }
-
-
-    if(d->type == I){
-        //i types
-        if(d->op == 9 || d->op == 12 || d->op == 13 ||
-           d->op == 15 || d-> op== 35){
-            *changedReg = d->regs.i.rt;
-            mips.registers[*changedReg] = val;
-            return;
-        }
-        //beq, bne, or sw
-        *changedReg = -1;
-        return;
-    }
-    
-    if(d->type == J){
-        //j types, this would be jal
-        if(d->op == 3){
-            *changedReg = 31;
-            mips.registers[*changedReg] = val;
-            return;
-        }
-        //j
-        *changedReg = -1;
-        return;
+    if (*changedReg != -1) {
+        mips->registers[*changedReg] = val;
     }
 }
@@ -1,14 +1,7 @@
 
-#define MAXNUMINSTRS 1024	/* max # instrs in a program */
-#define MAXNUMDATA 3072		/* max # data words */
-
-struct SimulatedComputer {
-    int memory [MAXNUMINSTRS+MAXNUMDATA];
-    int registers [32];
-    int pc;
-    int printingRegisters, printingMemory, interactive, debugging;
-};
-typedef struct SimulatedComputer Computer;
+#define MAXNUMINSTRS 1024	/* max # instrs in a program, course layout */
+#define MAXNUMDATA 3072		/* max # data words, course layout */
+#define PAGEWORDS 1024		/* words in a 4 KiB page */
 
 typedef enum { R=0, I, J } InstrType;
 
@@ -30,9 +23,13 @@ typedef struct {
   int target;
 } JRegs;
 
+struct InstrInfo;
+struct SimulatedComputer;
+
 typedef struct {
   InstrType type;
   int op;
+  const struct InstrInfo *info;	/* what it is, or NULL if not an instruction */
   union {
     RRegs r;
     IRegs i;
@@ -46,6 +43,173 @@ typedef struct {
   int R_rd;
 } RegVals;
 
-void InitComputer (FILE*, int printingRegisters, int printingMemory,
-    int debugging, int interactive);
-void Simulate ();
+/*
+ *  The decoder's table entry for an instruction: how it prints, which
+ *  registers it reads and writes, what it does to memory and where it
+ *  leaves the pc. exec computes the value the later stages work with
+ *  (an ALU result, an effective address, or a return address); cond
+ *  says whether a branch is taken. The tables are in isa.c.
+ */
+typedef enum { IMM_SIGNED=0, IMM_ZERO, IMM_BRANCH } ImmKind;
+typedef enum { W_NONE=0, W_RD, W_RT, W_R31, W_V0, W_HILO } Writeback;
+typedef enum { PC_NEXT=0, PC_BRANCH, PC_JUMP, PC_JUMPREG } PcKind;
+/* Loads, then stores */
+typedef enum {
+    M_NONE=0, M_LB, M_LBU, M_LH, M_LHU, M_LW, M_LWL, M_LWR,
+    M_SB, M_SH, M_SW, M_SWL, M_SWR
+} MemKind;
+
+#define READS_RS 1
+#define READS_RT 2
+
+typedef struct InstrInfo {
+    const char *name;		/* NULL for the course subset's nop */
+    const char *syntax;		/* operands, see Disassemble() */
+    ImmKind imm;
+    int reads;			/* READS_RS and/or READS_RT */
+    Writeback wb;
+    MemKind mem;
+    PcKind next;
+    int (*exec) (struct SimulatedComputer*, DecodedInstr*, RegVals*);
+    int (*cond) (int rs, int rt);
+    int subset;			/* one of the course's instructions */
+} InstrInfo;
+
+/*
+ *  Memory is a sparse 32-bit address space of 4 KiB pages, found through
+ *  a two-level table indexed by address bits 31-22 and 21-12. A page is
+ *  only allocated when it is first written; reading a page that hasn't
+ *  been touched gives zeroes. Addresses are only valid inside one of the
+ *  computer's regions, all of which start and end on page boundaries.
+ */
+typedef struct {
+    int *words [1024];		/* each page of this 4 MiB span, or NULL */
+    unsigned long long *nonzero [1024];	/* bit k: word k of the page is nonzero */
+} PageTable;
+
+typedef enum { SEG_TEXT=0, SEG_DATA, SEG_HEAP, SEG_STACK, NUMSEGS } Segment;
+
+typedef struct {
+    unsigned int base, limit;	/* [base, limit) */
+} Region;
+
+/*
+ *  Where the regions go. LAYOUT_COURSE is the original 16 KiB machine:
+ *  1024 words of text at 0x00400000, data up to 0x00404000 and $sp at
+ *  its end. LAYOUT_SPIM puts text, data, heap and stack where SPIM
+ *  does, with room for programs and arrays of any realistic size.
+ */
+typedef enum { LAYOUT_COURSE=0, LAYOUT_SPIM } Layout;
+
+/* Why the simulation stopped */
+typedef enum {
+    RUNNING=0, HALT_UNSUPPORTED, HALT_MEMORY, HALT_OVERFLOW, HALT_LIMIT, HALT_LOOP,
+    HALT_EXIT
+} HaltReason;
+
+/* How Simulate() runs the program; only STAGED prints a trace */
+typedef enum { STAGED=0, THREADED, JIT } Engine;
+
+struct SimulatedComputer {
+    PageTable *pageDir [1024];	/* two-level page table, see above */
+    Region regions [NUMSEGS];
+    Layout layout;
+    int *pageList;		/* allocated page numbers (addr>>12), ascending */
+    int numPages, maxPages;
+    struct Mapping *mappings;	/* mmap'd memory the pages live in */
+    int numMappings, maxMappings;
+    char *arenaNext;		/* unused pages in the newest mapping */
+    int arenaLeft;
+    int textWords;		/* words in the text region */
+    DecodedInstr *decoded;	/* pre-decoded text segment, textWords long */
+    int registers [32];
+    int hi, lo;			/* mult and div results */
+    int pc;
+    unsigned int heapBreak;	/* end of the heap sbrk has handed out */
+    int fullIsa;		/* all of MIPS-I, not just the course subset */
+    int printingRegisters, printingMemory, interactive, debugging;
+    Engine engine;
+    int quiet;			/* STAGED without the trace */
+    int selfLoops;		/* THREADED and JIT stop at a branch to itself */
+    struct TraceWriter *trace;	/* binary trace of a quiet run, or NULL */
+    struct JitState *jit;	/* JIT engine's translations, or NULL */
+    struct Pipeline *pipeline;	/* timing model fed by the stages, or NULL */
+    struct Ooo *ooo;		/* out-of-order timing model, likewise */
+    struct Ilp *ilp;		/* dataflow limit analysis, likewise */
+    struct LoopCheck *loops;	/* stops a run that is stuck, likewise */
+    struct Console *console;	/* syscall output not yet written, or NULL */
+    struct Predictors *predictors;	/* branch predictors fed likewise */
+    struct Profile *profile;	/* execution counts, likewise */
+    struct StateHash *hashes;	/* rolling hash of the run, likewise */
+    struct UndoLog *undo;	/* for going backwards, likewise */
+    unsigned long long *breaks;	/* bit k: breakpoint on text word k, or NULL */
+    struct Watches *watches;	/* watched data words, or NULL; see debug.c */
+    long instrCount;		/* instructions executed so far */
+    long stopAt;		/* engines stop when instrCount gets here */
+    long maxInsns;		/* Simulate() stops with HALT_LIMIT here */
+    HaltReason halted;
+    int haltAddr;		/* offending address for HALT_MEMORY */
+};
+typedef struct SimulatedComputer Computer;
+
+int InitComputer (Computer*, FILE*, Layout, int printingRegisters,
+    int printingMemory, int debugging, int interactive);
+void ClearComputer (Computer*, Layout);
+int PredecodeText (Computer*);
+int CopyComputer (Computer* to, Computer* from);
+void FreeComputer (Computer*);
+void Simulate (Computer*);
+long StepN (Computer*, long n);
+int Step (Computer*, int *changedReg, int *changedMem);
+const char *HaltName (HaltReason);
+unsigned int Fetch (Computer*, int);
+void Decode (unsigned int, int, DecodedInstr*);
+void DecodeAs (unsigned int, int, DecodedInstr*, int fullIsa);
+void SetFullIsa (Computer*, int);
+void Predecode (Computer*, int);
+int IsSupported (DecodedInstr*);
+int SourceRegs (DecodedInstr*, int srcs[2]);
+int DestReg (DecodedInstr*);
+int Disassemble (DecodedInstr*, char *buf, int size);
+void PrintInstruction (DecodedInstr*);
+void PrintInfo (Computer*, int changedReg, int changedMem);
+void PrintSummary (Computer*);
+void RunThreaded (Computer*);
+void RunJit (Computer*);
+void FreeJit (Computer*);
+
+/* memory.c */
+void InitMemory (Computer*, Layout);
+void FreeMemory (Computer*);
+int IsMapped (Computer*, unsigned int addr);
+int IsText (Computer*, unsigned int addr);
+int ReadWord (Computer*, unsigned int addr, int *value);
+int WriteWord (Computer*, unsigned int addr, int value);
+int *AllocPage (Computer*, unsigned int addr);
+void InstallPage (Computer*, unsigned int addr, int *page,
+    const unsigned long long *bits);
+void AddMapping (Computer*, void *addr, size_t len);
+void ScanMemory (Computer*);
+void PrintNonzero (Computer*);
+
+/* checkpoint.c */
+int SaveCheckpoint (Computer*, const char *path);
+int LoadCheckpoint (Computer*, const char *path);
+
+/* isa.c */
+const InstrInfo *LookupInstr (unsigned int instr, int fullIsa);
+
+/* syscall.c */
+int Syscall (Computer*, DecodedInstr*, RegVals*);
+void FlushConsole (Computer*);
+void FreeConsole (Computer*);
+
+/* emit.c */
+int EmitC (Computer*, FILE*);
+
+/* The page holding addr, or NULL if it hasn't been allocated. */
+static inline int *PageOf (Computer* mips, unsigned int addr) {
+    PageTable *t = mips->pageDir[addr >> 22];
+
+    return t == NULL ? NULL : t->words[(addr >> 12) & 1023];
+}
@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "computer.h"
+#include "debug.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Watched words are found like pages are: a directory indexed by
+ *  address bits 31-22 and tables by bits 21-12, leading to a bitmap of
+ *  the page's 1024 words. Only pages with a watchpoint have one.
+ */
+typedef struct {
+    unsigned long long *bits [1024];	/* bit k: word k of the page */
+} WatchTable;
+
+struct Watches {
+    WatchTable *dir [1024];
+    int hit;			/* a watched word changed */
+    unsigned int addr;		/* which, */
+    int old, new;		/* from what to what */
+};
+
+/*
+ *  Set (on) or clear the breakpoint at pc. Returns -1 if pc isn't a
+ *  word of the text segment.
+ */
+int SetBreakpoint (Computer* mips, unsigned int pc, int on) {
+    unsigned int k = (pc - mips->regions[SEG_TEXT].base) >> 2;
+
+    if (pc % 4 != 0 || k >= mips->textWords) {
+        return -1;
+    }
+    if (mips->breaks == NULL) {
+        mips->breaks = calloc ((mips->textWords + 63) / 64, sizeof(unsigned long long));
+        if (mips->breaks == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    if (on) {
+        mips->breaks[k / 64] |= 1ULL << (k % 64);
+    } else {
+        mips->breaks[k / 64] &= ~(1ULL << (k % 64));
+    }
+    return 0;
+}
+
+int IsBreakpoint (Computer* mips, unsigned int pc) {
+    unsigned int k = (pc - mips->regions[SEG_TEXT].base) >> 2;
+
+    return mips->breaks != NULL && pc % 4 == 0 && k < mips->textWords
+        && (mips->breaks[k / 64] >> (k % 64)) & 1;
+}
+
+/*
+ *  Set (on) or clear the watchpoint on the word at addr. Returns -1 if
+ *  addr isn't a word of memory.
+ */
+int SetWatchpoint (Computer* mips, unsigned int addr, int on) {
+    Watches *w = mips->watches;
+    WatchTable *t;
+    unsigned long long **bits;
+    unsigned int k = (addr >> 2) & 1023;
+
+    if (!IsMapped (mips, addr)) {
+        return -1;
+    }
+    if (w == NULL) {
+        w = mips->watches = calloc (1, sizeof(Watches));
+    }
+    if (w != NULL && w->dir[addr >> 22] == NULL) {
+        w->dir[addr >> 22] = calloc (1, sizeof(WatchTable));
+    }
+    if (w == NULL || (t = w->dir[addr >> 22]) == NULL) {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+    }
+    bits = &t->bits[(addr >> 12) & 1023];
+    if (*bits == NULL) {
+        *bits = calloc (PAGEWORDS/64, sizeof(unsigned long long));
+        if (*bits == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    if (on) {
+        (*bits)[k / 64] |= 1ULL << (k % 64);
+    } else {
+        (*bits)[k / 64] &= ~(1ULL << (k % 64));
+    }
+    return 0;
+}
+
+/* Whether the word at addr, which is aligned, is watched */
+int IsWatched (Watches *w, unsigned int addr) {
+    WatchTable *t = w->dir[addr >> 22];
+    unsigned long long *bits;
+    unsigned int k = (addr >> 2) & 1023;
+
+    if (t == NULL || (bits = t->bits[(addr >> 12) & 1023]) == NULL) {
+        return 0;
+    }
+    return (bits[k / 64] >> (k % 64)) & 1;
+}
+
+/*
+ *  Note that the store being executed changed the watched word at addr
+ *  from old to new, and have the engine stop once it completes.
+ */
+void WatchHit (Computer* mips, unsigned int addr, int old, int new) {
+    Watches *w = mips->watches;
+
+    w->hit = 1;
+    w->addr = addr;
+    w->old = old;
+    w->new = new;
+    mips->stopAt = mips->instrCount + 1;
+}
+
+/*
+ *  If a watched word changed since the last call, say how and return
+ *  1; otherwise return 0.
+ */
+int TakeWatchHit (Computer* mips, unsigned int *addr, int *old, int *new) {
+    Watches *w = mips->watches;
+
+    if (w == NULL || !w->hit) {
+        return 0;
+    }
+    w->hit = 0;
+    *addr = w->addr;
+    *old = w->old;
+    *new = w->new;
+    return 1;
+}
+
+void FreeDebug (Computer* mips) {
+    int d, k;
+
+    if (mips->watches != NULL) {
+        for (d=0; d<1024; d++) {
+            if (mips->watches->dir[d] != NULL) {
+                for (k=0; k<1024; k++) {
+                    free (mips->watches->dir[d]->bits[k]);
+                }
+                free (mips->watches->dir[d]);
+            }
+        }
+        free (mips->watches);
+        mips->watches = NULL;
+    }
+    free (mips->breaks);
+    mips->breaks = NULL;
+}
@@ -0,0 +1,16 @@
+/*
+ *  Breakpoints and watchpoints for interactive mode. Breakpoints are a
+ *  bitmap over the words of the text segment, checked by RunQuiet()
+ *  before each instruction; watchpoints a bitmap over data words,
+ *  checked by Mem() when it stores. Include computer.h first.
+ */
+
+typedef struct Watches Watches;
+
+int SetBreakpoint (Computer*, unsigned int pc, int on);
+int IsBreakpoint (Computer*, unsigned int pc);
+int SetWatchpoint (Computer*, unsigned int addr, int on);
+int IsWatched (Watches*, unsigned int addr);
+void WatchHit (Computer*, unsigned int addr, int old, int new);
+int TakeWatchHit (Computer*, unsigned int *addr, int *old, int *new);
+void FreeDebug (Computer*);
@@ -0,0 +1,460 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Ahead-of-time translation of a loaded program into C.
+ *
+ *  The output is one self-contained C file: the computer's memory image,
+ *  registers and regions, a small runtime, and a Run() function with a
+ *  label for every basic block of the text segment and the code for each
+ *  instruction written out in between, doing what Execute(), Mem() and
+ *  RegWrite() would. Branches and jumps into the text segment are plain
+ *  gotos. jr, and anything else whose target isn't known until run time,
+ *  goes through a switch on the pc over the block labels; a pc that
+ *  isn't one of them is run by an interpreter in the runtime, an
+ *  instruction at a time, until it gets back to one. So is everything
+ *  after a store into the text segment, since the translation no longer
+ *  matches it.
+ *
+ *  Built with gcc -O2, the result runs the program and prints what
+ *  sim -q would, with the same exception messages; given -m it prints
+ *  the nonzero memory as well, like sim -q -m.
+ */
+
+/* Everything in the output that doesn't depend on the program */
+static const char *runtime[] = {
+    "#include <stdio.h>",
+    "#include <stdlib.h>",
+    "#include <string.h>",
+    "",
+    "enum { RUNNING=0, HALT_UNSUPPORTED, HALT_MEMORY, HALT_LOOP };",
+    "",
+    "static int reg [32];",
+    "static unsigned int pc;",
+    "static long count;",
+    "static int halted, haltAddr;",
+    "static int smc;			/* the text segment has been stored into */",
+    "static int **dir [1024];		/* dir[addr>>22][(addr>>12)&1023]: 1024-word page */",
+    "",
+    "static int IsMapped (unsigned int addr) {",
+    "    int k;",
+    "",
+    "    if (addr % 4 != 0) {",
+    "        return 0;",
+    "    }",
+    "    for (k=0; k<4; k++) {",
+    "        if (addr >= regionBase[k] && addr < regionLimit[k]) {",
+    "            return 1;",
+    "        }",
+    "    }",
+    "    return 0;",
+    "}",
+    "",
+    "static int IsText (unsigned int addr) {",
+    "    return addr - regionBase[0] < regionLimit[0] - regionBase[0];",
+    "}",
+    "",
+    "/* The page holding addr, allocating it if alloc is set, or NULL */",
+    "static int *Page (unsigned int addr, int alloc) {",
+    "    int **t = dir[addr >> 22];",
+    "",
+    "    if (t == NULL && alloc) {",
+    "        t = dir[addr >> 22] = calloc (1024, sizeof(int *));",
+    "    }",
+    "    if (t != NULL && t[(addr >> 12) & 1023] == NULL && alloc) {",
+    "        t[(addr >> 12) & 1023] = calloc (1024, sizeof(int));",
+    "    }",
+    "    if (alloc && (t == NULL || t[(addr >> 12) & 1023] == NULL)) {",
+    "        fprintf (stderr, \"Out of memory.\\n\");",
+    "        exit (1);",
+    "    }",
+    "    return t == NULL ? NULL : t[(addr >> 12) & 1023];",
+    "}",
+    "",
+    "/* Put the word at addr in *value. Returns 0 if addr isn't a mapped word. */",
+    "static inline int Load (unsigned int addr, int *value) {",
+    "    int *p = Page (addr, 0);",
+    "",
+    "    if (p != NULL && addr % 4 == 0) {",
+    "        *value = p[(addr >> 2) & 1023];",
+    "        return 1;",
+    "    }",
+    "    if (!IsMapped (addr)) {",
+    "        return 0;",
+    "    }",
+    "    *value = 0;",
+    "    return 1;",
+    "}",
+    "",
+    "/* Store value at addr. Returns 0 if addr isn't a mapped word. */",
+    "static inline int Store (unsigned int addr, int value) {",
+    "    int *p = Page (addr, 0);",
+    "",
+    "    if (p == NULL || addr % 4 != 0) {",
+    "        if (!IsMapped (addr)) {",
+    "            return 0;",
+    "        }",
+    "        p = Page (addr, 1);",
+    "    }",
+    "    p[(addr >> 2) & 1023] = value;",
+    "    if (IsText (addr)) {",
+    "        smc = 1;",
+    "    }",
+    "    return 1;",
+    "}",
+    "",
+    "/* Run the instruction at pc as sim would. Returns 0 once the program stops. */",
+    "static int Step (void) {",
+    "    unsigned int instr, rs, rt, rd, shamt, addr, next = pc + 4;",
+    "    int imm, value;",
+    "",
+    "    if (!IsMapped (pc)) {",
+    "        halted = HALT_MEMORY;",
+    "        haltAddr = pc;",
+    "        return 0;",
+    "    }",
+    "    Load (pc, &value);",
+    "    instr = value;",
+    "    rs = (instr >> 21) & 31;",
+    "    rt = (instr >> 16) & 31;",
+    "    rd = (instr >> 11) & 31;",
+    "    shamt = (instr >> 6) & 31;",
+    "    imm = (short) (instr & 0xffff);",
+    "    switch (instr >> 26) {",
+    "        case 0:",
+    "            switch (instr & 63) {",
+    "                case 0: reg[rd] = (unsigned int) reg[rt] << shamt; break;",
+    "                case 2: reg[rd] = (unsigned int) reg[rt] >> shamt; break;",
+    "                case 8: next = reg[rs]; break;",
+    "                case 33: reg[rd] = (unsigned int) reg[rs] + reg[rt]; break;",
+    "                case 35: reg[rd] = (unsigned int) reg[rs] - reg[rt]; break;",
+    "                case 36: reg[rd] = reg[rs] & reg[rt]; break;",
+    "                case 37: reg[rd] = reg[rs] | reg[rt]; break;",
+    "                case 42: reg[rd] = reg[rs] < reg[rt]; break;",
+    "            }",
+    "            break;",
+    "        case 2: next = (instr << 6) >> 4; break;",
+    "        case 3: reg[31] = pc + 4; next = (instr << 6) >> 4; break;",
+    "        case 4: if (reg[rs] == reg[rt]) next = pc + 4 + 4*imm; break;",
+    "        case 5: if (reg[rs] != reg[rt]) next = pc + 4 + 4*imm; break;",
+    "        case 9: reg[rt] = (unsigned int) reg[rs] + imm; break;",
+    "        case 12: reg[rt] = reg[rs] & (instr & 0xffff); break;",
+    "        case 13: reg[rt] = reg[rs] | (instr & 0xffff); break;",
+    "        case 15: reg[rt] = instr << 16; break;",
+    "        case 35:",
+    "            addr = reg[rs] + imm;",
+    "            if (!Load (addr, &value)) {",
+    "                halted = HALT_MEMORY;",
+    "                haltAddr = addr;",
+    "                return 0;",
+    "            }",
+    "            reg[rt] = value;",
+    "            break;",
+    "        case 43:",
+    "            addr = reg[rs] + imm;",
+    "            if (!Store (addr, reg[rt])) {",
+    "                halted = HALT_MEMORY;",
+    "                haltAddr = addr;",
+    "                return 0;",
+    "            }",
+    "            break;",
+    "        default:",
+    "            halted = HALT_UNSUPPORTED;",
+    "            return 0;",
+    "    }",
+    "    count++;",
+    "    if (next == pc && selfLoops) {",
+    "        halted = HALT_LOOP;",
+    "        return 0;",
+    "    }",
+    "    pc = next;",
+    "    return 1;",
+    "}",
+    "",
+    "static void PrintSummary (int printingMemory) {",
+    "    unsigned int d, p, k, addr;",
+    "    int value = 0, *page;",
+    "",
+    "    if (halted == HALT_MEMORY) {",
+    "        printf (\"Memory Access Exception at 0x%.8x: address 0x%.8x\\n\", pc, haltAddr);",
+    "    } else if (halted == HALT_LOOP) {",
+    "        printf (\"Stuck in a loop at 0x%.8x\\n\", pc);",
+    "    } else if (halted == HALT_UNSUPPORTED) {",
+    "        Load (pc, &value);",
+    "        printf (\"Unsupported instruction at %8.8x: %8.8x\\n\", pc, value);",
+    "    }",
+    "    printf (\"Executed %ld instructions\\n\", count);",
+    "    printf (\"Final pc = %8.8x\\n\", pc);",
+    "    for (k=0; k<32; k++) {",
+    "        printf (\"r%2.2d: %8.8x  \", k, reg[k]);",
+    "        if ((k+1)%4 == 0) {",
+    "            printf (\"\\n\");",
+    "        }",
+    "    }",
+    "    if (!printingMemory) {",
+    "        return;",
+    "    }",
+    "    printf (\"Nonzero memory\\n\");",
+    "    printf (\"ADDR\\t  CONTENTS\\n\");",
+    "    for (d=0; d<1024; d++) {",
+    "        for (p=0; dir[d] != NULL && p<1024; p++) {",
+    "            page = dir[d][p];",
+    "            addr = (d << 22) | (p << 12);",
+    "            if (page == NULL || IsText (addr)) {",
+    "                continue;",
+    "            }",
+    "            for (k=0; k<1024; k++) {",
+    "                if (page[k] != 0) {",
+    "                    printf (\"%8.8x  %8.8x\\n\", addr + 4*k, page[k]);",
+    "                }",
+    "            }",
+    "        }",
+    "    }",
+    "}",
+    NULL
+};
+
+/* Where control goes to addr: a block label if there is one, else the switch */
+static void EmitGoto (FILE* out, Computer* mips, char *leader, unsigned int addr) {
+    unsigned int k = (addr - mips->regions[SEG_TEXT].base) / 4;
+
+    if (addr % 4 == 0 && k < mips->textWords && leader[k]) {
+        fprintf (out, "goto L_%8.8x;", addr);
+    } else {
+        fprintf (out, "{ pc = 0x%8.8xu; goto dispatch; }", addr);
+    }
+}
+
+/*
+ *  Where a branch or jump at addr goes to target. One to itself stops
+ *  the program as stuck in a loop, as on the threaded engine, unless
+ *  mips->selfLoops is off.
+ */
+static void EmitBranch (FILE* out, Computer* mips, char *leader, unsigned int addr,
+  unsigned int target) {
+    if (target == addr && mips->selfLoops) {
+        fprintf (out, "{ pc = 0x%8.8x; halted = HALT_LOOP; return; }", addr);
+    } else {
+        EmitGoto (out, mips, leader, target);
+    }
+}
+
+/* Code for the instruction d at addr; the program stops at an exception */
+static void EmitInstr (FILE* out, Computer* mips, char *leader, DecodedInstr* d,
+  unsigned int addr) {
+    int rs = d->regs.r.rs, rt = d->regs.r.rt, rd = d->regs.r.rd;
+    int imm = d->regs.i.addr_or_immed;
+
+    switch (d->op) {
+        case 0:
+            switch (d->regs.r.funct) {
+                case 0:
+                    fprintf (out, "    reg[%d] = (unsigned int) reg[%d] << %d;\n",
+                             rd, rt, d->regs.r.shamt);
+                    break;
+                case 2:
+                    fprintf (out, "    reg[%d] = (unsigned int) reg[%d] >> %d;\n",
+                             rd, rt, d->regs.r.shamt);
+                    break;
+                case 8:
+                    fprintf (out, "    count++;\n    pc = reg[%d];\n", rs);
+                    if (mips->selfLoops) {
+                        fprintf (out, "    if (pc == 0x%8.8x) { halted = HALT_LOOP; return; }\n",
+                                 addr);
+                    }
+                    fprintf (out, "    goto dispatch;\n");
+                    return;
+                case 33:
+                    fprintf (out, "    reg[%d] = (unsigned int) reg[%d] + reg[%d];\n", rd, rs, rt);
+                    break;
+                case 35:
+                    fprintf (out, "    reg[%d] = (unsigned int) reg[%d] - reg[%d];\n", rd, rs, rt);
+                    break;
+                case 36:
+                    fprintf (out, "    reg[%d] = reg[%d] & reg[%d];\n", rd, rs, rt);
+                    break;
+                case 37:
+                    fprintf (out, "    reg[%d] = reg[%d] | reg[%d];\n", rd, rs, rt);
+                    break;
+                case 42:
+                    fprintf (out, "    reg[%d] = reg[%d] < reg[%d];\n", rd, rs, rt);
+                    break;
+            }
+            fprintf (out, "    count++;\n");
+            return;
+        case 2:
+        case 3:
+            if (d->op == 3) {
+                fprintf (out, "    reg[31] = 0x%8.8x;\n", addr + 4);
+            }
+            fprintf (out, "    count++;\n    ");
+            if (d->op == 2) {
+                EmitBranch (out, mips, leader, addr, d->regs.j.target);
+            } else {
+                EmitGoto (out, mips, leader, d->regs.j.target);
+            }
+            fprintf (out, "\n");
+            return;
+        case 4:
+        case 5:
+            rs = d->regs.i.rs;
+            rt = d->regs.i.rt;
+            fprintf (out, "    count++;\n    if (reg[%d] %s reg[%d]) ", rs,
+                     d->op == 4 ? "==" : "!=", rt);
+            EmitBranch (out, mips, leader, addr, imm);
+            fprintf (out, "\n");
+            return;
+        case 9:
+            fprintf (out, "    reg[%d] = (unsigned int) reg[%d] + %d;\n", d->regs.i.rt,
+                     d->regs.i.rs, imm);
+            break;
+        case 12:
+            fprintf (out, "    reg[%d] = reg[%d] & 0x%x;\n", d->regs.i.rt, d->regs.i.rs, imm);
+            break;
+        case 13:
+            fprintf (out, "    reg[%d] = reg[%d] | 0x%x;\n", d->regs.i.rt, d->regs.i.rs, imm);
+            break;
+        case 15:
+            fprintf (out, "    reg[%d] = 0x%8.8x;\n", d->regs.i.rt, (unsigned int) imm << 16);
+            break;
+        case 35:
+        case 43:
+            fprintf (out, "    addr = reg[%d] + %d;\n", d->regs.i.rs, imm);
+            if (d->op == 35) {
+                fprintf (out, "    if (!Load (addr, &value)) ");
+            } else {
+                fprintf (out, "    if (!Store (addr, reg[%d])) ", d->regs.i.rt);
+            }
+            fprintf (out, "{ pc = 0x%8.8x; haltAddr = addr; halted = HALT_MEMORY; return; }\n",
+                     addr);
+            if (d->op == 35) {
+                fprintf (out, "    reg[%d] = value;\n", d->regs.i.rt);
+                break;
+            }
+            fprintf (out, "    count++;\n");
+            fprintf (out, "    if (smc) { pc = 0x%8.8x; goto dispatch; }\n", addr + 4);
+            return;
+        default:
+            fprintf (out, "    pc = 0x%8.8x;\n    halted = HALT_UNSUPPORTED;\n    return;\n",
+                     addr);
+            return;
+    }
+    fprintf (out, "    count++;\n");
+}
+
+/*
+ *  Write the computer, as it stands, to out as a C program that carries
+ *  on from there. Returns -1 if it can't be written.
+ */
+int EmitC (Computer* mips, FILE* out) {
+    unsigned int textBase = mips->regions[SEG_TEXT].base, addr;
+    char *leader, buf[40];
+    DecodedInstr *d;
+    int k, p, n, w, words = 0, loads = 0, stores = 0;
+    int *page;
+
+    leader = calloc (mips->textWords + 1, 1);
+    if (leader == NULL) {
+        return -1;
+    }
+
+    /* Blocks start where the run starts and wherever control can land */
+    if (IsText (mips, mips->pc) && mips->pc % 4 == 0) {
+        leader[(mips->pc - textBase) / 4] = 1;
+    }
+    for (k=0; k<mips->textWords; k++) {
+        d = &mips->decoded[k];
+        if (!IsSupported (d) || d->op == 2 || d->op == 3 || d->op == 4 || d->op == 5
+            || (d->op == 0 && d->regs.r.funct == 8)) {
+            leader[k+1] = 1;
+        }
+        addr = d->op == 2 || d->op == 3 ? d->regs.j.target : d->regs.i.addr_or_immed;
+        if ((d->op == 2 || d->op == 3 || d->op == 4 || d->op == 5)
+            && IsText (mips, addr) && addr % 4 == 0) {
+            leader[(addr - textBase) / 4] = 1;
+        }
+    }
+
+    fprintf (out, "/* Translated by sim --emit-c; build with gcc -O2. */\n\n");
+    fprintf (out, "static const unsigned int regionBase [4] = {");
+    for (k=0; k<NUMSEGS; k++) {
+        fprintf (out, "%s0x%8.8x", k ? ", " : " ", mips->regions[k].base);
+    }
+    fprintf (out, " };\nstatic const unsigned int regionLimit [4] = {");
+    for (k=0; k<NUMSEGS; k++) {
+        fprintf (out, "%s0x%8.8x", k ? ", " : " ", mips->regions[k].limit);
+    }
+    fprintf (out, " };\n");
+    fprintf (out, "static const int selfLoops = %d;\n\n", mips->selfLoops);
+    for (k=0; runtime[k] != NULL; k++) {
+        fprintf (out, "%s\n", runtime[k]);
+    }
+
+    /* The nonzero words of memory, text included */
+    fprintf (out, "\nstatic const unsigned int image [][2] = {\n");
+    for (p=0; p<mips->numPages; p++) {
+        n = mips->pageList[p];
+        page = mips->pageDir[n >> 10]->words[n & 1023];
+        for (w=0; w<PAGEWORDS; w++) {
+            if (page[w] != 0) {
+                fprintf (out, "    { 0x%8.8x, 0x%8.8x },\n", ((unsigned int) n << 12) + 4*w,
+                         page[w]);
+                words++;
+            }
+        }
+    }
+    fprintf (out, "    { 0, 0 }\n};\n\n");
+    fprintf (out, "static const int startRegs [32] = {\n");
+    for (k=0; k<32; k++) {
+        fprintf (out, "%s0x%8.8x,%s", k%4 == 0 ? "    " : " ", mips->registers[k],
+                 k%4 == 3 ? "\n" : "");
+    }
+    fprintf (out, "};\n\n");
+
+    fprintf (out, "static void Run (void) {\n");
+    for (k=0; k<mips->textWords; k++) {
+        loads |= mips->decoded[k].op == 35;
+        stores |= mips->decoded[k].op == 43;
+    }
+    fprintf (out, "%s%s\n", loads || stores ? "    unsigned int addr;\n" : "",
+             loads ? "    int value;\n" : "");
+    fprintf (out, "    goto dispatch;\n");
+    for (k=0; k<mips->textWords; k++) {
+        addr = textBase + 4*k;
+        if (leader[k]) {
+            fprintf (out, "L_%8.8x:\n", addr);
+        }
+        Disassemble (&mips->decoded[k], buf, sizeof(buf));
+        fprintf (out, "    /* %8.8x: %s */\n", addr, buf);
+        EmitInstr (out, mips, leader, &mips->decoded[k], addr);
+    }
+    fprintf (out, "    pc = 0x%8.8x;\n\n", textBase + 4*mips->textWords);
+
+    fprintf (out, "dispatch:\n");
+    fprintf (out, "    if (!smc) {\n        switch (pc) {\n");
+    for (k=0; k<mips->textWords; k++) {
+        if (leader[k]) {
+            fprintf (out, "            case 0x%8.8x: goto L_%8.8x;\n", textBase + 4*k,
+                     textBase + 4*k);
+        }
+    }
+    fprintf (out, "        }\n    }\n");
+    fprintf (out, "    if (!Step ()) {\n        return;\n    }\n    goto dispatch;\n}\n\n");
+
+    fprintf (out, "int main (int argc, char *argv[]) {\n");
+    fprintf (out, "    int k;\n\n");
+    fprintf (out, "    for (k=0; k<%d; k++) {\n", words);
+    fprintf (out, "        Page (image[k][0], 1)[(image[k][0] >> 2) & 1023] = image[k][1];\n");
+    fprintf (out, "    }\n");
+    fprintf (out, "    memcpy (reg, startRegs, sizeof(reg));\n");
+    fprintf (out, "    pc = 0x%8.8x;\n", mips->pc);
+    fprintf (out, "    count = %ldL;\n", mips->instrCount);
+    fprintf (out, "    Run ();\n");
+    fprintf (out, "    PrintSummary (argc > 1 && strcmp (argv[1], \"-m\") == 0);\n");
+    fprintf (out, "    return 0;\n}\n");
+    free (leader);
+    return ferror (out) ? -1 : 0;
+}
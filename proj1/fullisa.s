@@ -0,0 +1,118 @@
+# The rest of MIPS-I, for sim -x. Each result is printed with print_int
+# on a line of its own; the expected value is in the comment. The last
+# add overflows and stops the program.
+#
+#	sim -x -s -q fullisa.dump
+
+		.text
+		lui	$s0,0x1001		# scratch memory
+		addiu	$t9,$0,10		# "\n" at 0x10010100 for Print
+		sw	$t9,0x100($s0)
+
+		# mult/div with HI/LO
+		addiu	$t0,$0,-7
+		addiu	$t1,$0,3
+		mult	$t0,$t1
+		mflo	$a0			# -21
+		jal	Print
+		mfhi	$a0			# -1
+		jal	Print
+		div	$t0,$t1
+		mflo	$a0			# -2
+		jal	Print
+		mfhi	$a0			# -1
+		jal	Print
+		multu	$t0,$t1
+		mfhi	$a0			# 2
+		jal	Print
+		divu	$t0,$t1
+		mflo	$a0			# 1431655763
+		jal	Print
+		addiu	$t2,$0,42
+		mthi	$t2
+		mfhi	$a0			# 42
+		jal	Print
+
+		# add/sub that don't overflow
+		add	$a0,$t0,$t1		# -4
+		jal	Print
+		sub	$a0,$t0,$t1		# -10
+		jal	Print
+
+		# sra/srav
+		sra	$a0,$t0,1		# -4
+		jal	Print
+		addiu	$t2,$0,2
+		srav	$a0,$t0,$t2		# -2
+		jal	Print
+
+		# slti/sltiu
+		slti	$a0,$t0,0		# 1
+		jal	Print
+		sltiu	$a0,$t0,5		# 0: -7 is big unsigned
+		jal	Print
+
+		# lb/lbu/lh/sb/sh on 0x80818283 (little-endian)
+		lui	$t2,0x8081
+		ori	$t2,$t2,0x8283
+		sw	$t2,0($s0)
+		lb	$a0,0($s0)		# -125
+		jal	Print
+		lbu	$a0,0($s0)		# 131
+		jal	Print
+		lh	$a0,2($s0)		# -32639
+		jal	Print
+		addiu	$t2,$0,0x7f
+		sb	$t2,1($s0)
+		sh	$t2,2($s0)
+		lw	$a0,0($s0)		# 8355715 = 0x007f7f83
+		jal	Print
+
+		# lwl/lwr: the unaligned word at 5 of 0x44332211, 0x88776655
+		lui	$t2,0x4433
+		ori	$t2,$t2,0x2211
+		sw	$t2,4($s0)
+		lui	$t2,0x8877
+		ori	$t2,$t2,0x6655
+		sw	$t2,8($s0)
+		addiu	$a0,$0,0
+		lwr	$a0,5($s0)
+		lwl	$a0,8($s0)		# 1430532898 = 0x55443322
+		jal	Print
+
+		# jalr
+		lui	$t3,0x0040
+		ori	$t3,$t3,Sub
+		jalr	$ra,$t3			# 5
+		jal	Print
+
+		# bltzal: taken for -7, not taken for 3
+		addiu	$a0,$0,0
+		bltzal	$t0,Sub			# 5
+		jal	Print
+		addiu	$a0,$0,0
+		bltzal	$t1,Sub			# 0
+		jal	Print
+
+		# add overflow: stops here
+		lui	$t4,0x7fff
+		ori	$t4,$t4,0xffff
+		addiu	$t5,$0,1
+		add	$t6,$t4,$t5
+		addiu	$a0,$0,99		# never reached
+		jal	Print
+
+
+Sub:
+		addiu	$a0,$0,5
+		jr	$ra
+
+# print_int $a0 and a newline
+Print:
+		addiu	$v0,$0,1
+		syscall
+		lui	$a0,0x1001
+		ori	$a0,$a0,0x100
+		addiu	$v0,$0,4
+		syscall
+		jr	$ra
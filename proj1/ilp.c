@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+#include "ilp.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Every instruction takes one cycle, and runs the cycle after the last
+ *  of its operands was produced: the registers it reads (HI and LO as
+ *  one), and for a load the latest store to the same word. Registers
+ *  are renamed and branches predicted perfectly, so nothing else
+ *  counts. With a window of n, an instruction also can't run before
+ *  the one n before it has retired, in order; without one, the run
+ *  takes as long as its longest dependence chain, the critical path.
+ *  Register 0 never carries a dependence.
+ *
+ *  All of the windows are worked out at once, in one pass over the
+ *  instructions as they run, and none of it grows with the length of
+ *  the run: each window keeps when its registers are ready and when its
+ *  last n instructions retired, and stores are remembered in a fixed
+ *  table, where a newer store may push out an older one to a different
+ *  word. Anything that table forgot is taken to have no dependence.
+ *
+ *  For the chains, each text word keeps the deepest it has been in the
+ *  unlimited graph and which word it most often depended on last (by
+ *  majority vote); following that back from the deepest words gives the
+ *  chains that set the critical path. Words outside the text region
+ *  count toward the totals but aren't part of any chain.
+ */
+
+#define HILO 32			/* register for HI and LO */
+#define MEMSLOTS (1 << 16)	/* stores remembered */
+
+typedef struct {
+    int size;			/* instructions in the window, 0 for no limit */
+    long *retired;		/* retire cycles of the last size instructions */
+    long lastRetire;
+    long ready [33];		/* cycle each register's value is ready */
+} Window;
+
+typedef struct {
+    unsigned int addr;		/* word stored to, or 0 */
+    int from;			/* text word that stored it, or -1 */
+    long ready [ILP_WINDOWS+1];	/* cycle it was stored, in each window */
+} Store;
+
+struct Ilp {
+    unsigned int textBase;
+    int textWords;
+    long *depth;		/* deepest each text word has been */
+    int *from;			/* word it most often depended on last, or -1 */
+    int *votes;			/* for from */
+    Window windows [ILP_WINDOWS+1];	/* the last one has no limit */
+    int regFrom [33];		/* text word that last wrote each register */
+    Store *stores;
+    long total;
+};
+
+Ilp *NewIlp (Computer* mips) {
+    Ilp *p = calloc (1, sizeof(Ilp));
+    int n = mips->textWords, k;
+
+    if (p == NULL) {
+        return NULL;
+    }
+    p->textBase = mips->regions[SEG_TEXT].base;
+    p->textWords = n;
+    p->depth = calloc (n, sizeof(long));
+    p->from = malloc ((n > 0 ? n : 1) * sizeof(int));
+    p->votes = calloc (n, sizeof(int));
+    p->stores = calloc (MEMSLOTS, sizeof(Store));
+    if (p->depth == NULL || p->from == NULL || p->votes == NULL || p->stores == NULL) {
+        FreeIlp (p);
+        return NULL;
+    }
+    for (k=0; k<ILP_WINDOWS; k++) {
+        p->windows[k].size = 16 << k;
+        p->windows[k].retired = calloc (16 << k, sizeof(long));
+        if (p->windows[k].retired == NULL) {
+            FreeIlp (p);
+            return NULL;
+        }
+    }
+    for (k=0; k<n; k++) {
+        p->from[k] = -1;
+    }
+    for (k=0; k<33; k++) {
+        p->regFrom[k] = -1;
+    }
+    return p;
+}
+
+/*
+ *  Account for d, at pc, having been executed; addr is the address it
+ *  loaded from or stored to, if it did either.
+ */
+void IlpStep (Ilp *p, DecodedInstr *d, unsigned int pc, unsigned int addr) {
+    unsigned int k = (pc - p->textBase) >> 2, word = addr & ~3;
+    const InstrInfo *info = d->info;
+    int srcs[3], n, j, w, dest, from = -1, self = -1;
+    int load = info->mem != M_NONE && info->mem < M_SB, store = info->mem >= M_SB;
+    Store *m = &p->stores[((word >> 2) * 2654435761u) >> 16];
+    Window *win = &p->windows[ILP_WINDOWS];
+    long t, latest = 0;
+
+    n = SourceRegs (d, srcs);
+    if (info->name != NULL && strncmp (info->name, "mf", 2) == 0) {
+        srcs[n++] = HILO;
+    }
+    dest = info->wb == W_HILO ? HILO : DestReg (d);
+    if (load && m->addr != word) {
+        load = 0;		/* no store to it remembered */
+    }
+
+    /* Which word this one depends on last, in the unlimited graph */
+    for (j=0; j<n; j++) {
+        if (srcs[j] != 0 && win->ready[srcs[j]] > latest) {
+            latest = win->ready[srcs[j]];
+            from = p->regFrom[srcs[j]];
+        }
+    }
+    if (load && m->ready[ILP_WINDOWS] > latest) {
+        from = m->from;
+    }
+
+    for (w=0; w<=ILP_WINDOWS; w++) {
+        win = &p->windows[w];
+        t = 0;
+        for (j=0; j<n; j++) {
+            if (srcs[j] != 0 && win->ready[srcs[j]] > t) {
+                t = win->ready[srcs[j]];
+            }
+        }
+        if (load && m->ready[w] > t) {
+            t = m->ready[w];
+        }
+        t++;
+        if (win->size > 0 && t <= win->retired[p->total % win->size]) {
+            t = win->retired[p->total % win->size] + 1;
+        }
+        if (dest > 0) {
+            win->ready[dest] = t;
+        }
+        if (store) {
+            m->ready[w] = t;
+        }
+        if (t > win->lastRetire) {
+            win->lastRetire = t;
+        }
+        if (win->size > 0) {
+            win->retired[p->total % win->size] = win->lastRetire;
+        }
+    }
+    p->total++;
+
+    /* t is its cycle in the unlimited graph, the last one worked out */
+    if (k < p->textWords) {
+        if (t > p->depth[k]) {
+            p->depth[k] = t;
+        }
+        if (p->votes[k] == 0) {
+            p->from[k] = from;
+            p->votes[k] = 1;
+        } else {
+            p->votes[k] += p->from[k] == from ? 1 : -1;
+        }
+        self = k;
+    }
+    if (dest > 0) {
+        p->regFrom[dest] = self;
+    }
+    if (store) {
+        m->addr = word;
+        m->from = self;
+    }
+}
+
+void PrintIlp (Ilp *p, Computer* mips) {
+    int *chain = calloc (p->textWords > 0 ? p->textWords : 1, sizeof(int));
+    long critical = p->windows[ILP_WINDOWS].lastRetire, cycles;
+    char buf[40];
+    int c, k, w, len;
+
+    if (chain == NULL) {
+        fprintf (stderr, "Out of memory.\n");
+        return;
+    }
+    printf ("Dataflow limit: %ld instructions, critical path %ld\n", p->total, critical);
+    printf ("WINDOW     CYCLES       ILP\n");
+    for (k=0; k<=ILP_WINDOWS; k++) {
+        cycles = p->windows[k].lastRetire;
+        if (k < ILP_WINDOWS) {
+            printf ("%-10d ", p->windows[k].size);
+        } else {
+            printf ("%-10s ", "unlimited");
+        }
+        printf ("%-12ld %.3f\n", cycles, cycles ? (double) p->total / cycles : 0.0);
+    }
+
+    /* chain[w] is the chain word w was shown in, from 1 */
+    printf ("Dependency chains, deepest first\n");
+    printf ("DEPTH        PC        INSTRUCTION\n");
+    for (c=1; c<=ILP_CHAINS; c++) {
+        for (w=-1, k=0; k<p->textWords; k++) {
+            if (chain[k] == 0 && p->depth[k] > 0 && (w < 0 || p->depth[k] > p->depth[w])) {
+                w = k;
+            }
+        }
+        if (w < 0) {
+            break;
+        }
+        printf ("chain %d\n", c);
+        for (len=0; w >= 0 && chain[w] == 0 && len < ILP_CHAIN_MAX; len++) {
+            chain[w] = c;
+            Disassemble (&mips->decoded[w], buf, sizeof(buf));
+            printf ("%-12ld %8.8x  %s\n", p->depth[w], p->textBase + 4*w, buf);
+            w = p->from[w];
+        }
+        if (w >= 0 && chain[w] == c) {
+            printf ("             (back to %8.8x)\n", p->textBase + 4*w);
+        } else if (w >= 0 && chain[w] != 0) {
+            printf ("             (joins chain %d at %8.8x)\n", chain[w], p->textBase + 4*w);
+        }
+    }
+    free (chain);
+}
+
+void FreeIlp (Ilp *p) {
+    int k;
+
+    for (k=0; k<ILP_WINDOWS; k++) {
+        free (p->windows[k].retired);
+    }
+    free (p->depth);
+    free (p->from);
+    free (p->votes);
+    free (p->stores);
+    free (p);
+}
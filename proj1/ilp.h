@@ -0,0 +1,17 @@
+/*
+ *  Dataflow limit of a run: how fast its instructions could go with
+ *  nothing but their true register and memory dependences holding them
+ *  back, for instruction windows of 16 to 1024 and without a limit, and
+ *  which chains of instructions set the pace. Include computer.h first.
+ */
+
+#define ILP_WINDOWS 7		/* windows of 16, 32, ... 1024 instructions */
+#define ILP_CHAINS 5		/* chains in the report */
+#define ILP_CHAIN_MAX 16	/* instructions shown of each */
+
+typedef struct Ilp Ilp;
+
+Ilp *NewIlp (Computer*);
+void IlpStep (Ilp*, DecodedInstr*, unsigned int pc, unsigned int addr);
+void PrintIlp (Ilp*, Computer*);
+void FreeIlp (Ilp*);
@@ -0,0 +1,470 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "computer.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Basic-block JIT tier.
+ *
+ *  RunJit() interprets the program with Step() and counts how often
+ *  each basic block is entered. A block starts at any instruction
+ *  reached by a beq/bne/j/jal/jr, or by leaving another block, and runs
+ *  through the next of those control instructions. Once a block has
+ *  been entered JIT_THRESHOLD times it is translated into x86-64 code
+ *  that works directly on mips->registers and the pages in
+ *  mips->pageDir, so the simulated machine state is always exactly
+ *  where the interpreter expects it.
+ *
+ *  A translated block adds its length to mips->instrCount on entry and
+ *  finishes by jumping straight into the translation of the next block,
+ *  or by returning the next pc if there isn't one yet. A block that
+ *  would take the count past mips->stopAt returns its own pc instead,
+ *  and the interpreter takes the remaining steps. lw and sw walk the
+ *  page table inline; if the address is misaligned, its page hasn't
+ *  been allocated, or a sw would modify the text segment, the block
+ *  sets *bailed and returns the pc of that instruction without
+ *  executing it (or counting it). The interpreter then runs it, so it
+ *  still raises the usual Memory Access Exception, allocates the page,
+ *  or goes through Predecode(). Any write to text throws away all
+ *  translated code.
+ *
+ *  A beq, bne or j to itself is never translated; a block stops short
+ *  of it, so the interpreter runs it and can stop the run with
+ *  HALT_LOOP when it is taken and changes nothing, as the threaded
+ *  engine does. A jr bails out to the interpreter the same way if it is
+ *  about to jump to itself.
+ *
+ *  Each computer gets its own code buffer and tables. On other hosts,
+ *  or if executable memory can't be had, RunJit() just uses the
+ *  threaded engine.
+ */
+
+#define JIT_THRESHOLD 50	/* block entries before translating it */
+#define JIT_MAXBLOCK 64		/* max instructions per translated block */
+#define JIT_MAXBYTES 64		/* max code bytes for one instruction */
+#define JIT_CODESIZE (4<<20)	/* bytes of translated code before a flush */
+
+#if defined(__x86_64__)
+
+typedef int (*BlockFn) (int *registers, PageTable **pageDir, int *bailed);
+
+struct JitState {
+    unsigned char *codeBuf;	/* JIT_CODESIZE bytes, rwx */
+    unsigned char *emit;	/* next free byte of codeBuf */
+    unsigned int textBase;	/* the computer's text region */
+    unsigned int textWords;
+    BlockFn *blocks;		/* translation of the block at each text word */
+    int *lengths;		/* instructions in each translated block */
+    int *hits;			/* entries into each untranslated block */
+    int countDisp;		/* &mips->instrCount relative to mips->registers */
+    int stopDisp;		/* &mips->stopAt relative to mips->registers */
+};
+typedef struct JitState JitState;
+
+/* x86 register numbers used by the emitters */
+#define EAX 0
+#define ECX 1
+
+static void Byte (JitState *j, int b) {
+    *j->emit++ = b;
+}
+
+static void Word (JitState *j, unsigned int w) {
+    memcpy (j->emit, &w, 4);
+    j->emit += 4;
+}
+
+/* mov x, [rdi + 4*r]: load simulated register r into eax or ecx */
+static void LoadReg (JitState *j, int x, int r) {
+    Byte (j, 0x8b); Byte (j, 0x47 | x<<3); Byte (j, 4*r);
+}
+
+/* mov [rdi + 4*r], eax */
+static void StoreReg (JitState *j, int r) {
+    Byte (j, 0x89); Byte (j, 0x47); Byte (j, 4*r);
+}
+
+/* mov eax, pc; ret */
+static void Return (JitState *j, unsigned int pc) {
+    Byte (j, 0xb8); Word (j, pc);
+    Byte (j, 0xc3);
+}
+
+/* Patch the rel8 of the short jump ending at at so it lands on j->emit. */
+static void Land (JitState *j, unsigned char *at) {
+    at[-1] = j->emit - at;
+}
+
+/*
+ *  End the block with the next pc in eax: jump into its translation
+ *  if it has one, else return it.
+ */
+static void Chain (JitState *j) {
+    unsigned char *out[3];
+    BlockFn *table = j->blocks;
+
+    Byte (j, 0x8d); Byte (j, 0x88); Word (j, -j->textBase);	/* lea ecx, [rax-textBase] */
+    Byte (j, 0x81); Byte (j, 0xf9); Word (j, 4*j->textWords-1);	/* cmp ecx, */
+    Byte (j, 0x77); Byte (j, 0); out[0] = j->emit;		/* ja */
+    Byte (j, 0xf6); Byte (j, 0xc1); Byte (j, 3);		/* test cl, 3 */
+    Byte (j, 0x75); Byte (j, 0); out[1] = j->emit;		/* jnz */
+    Byte (j, 0x49); Byte (j, 0xb8);				/* mov r8, blocks */
+    memcpy (j->emit, &table, 8); j->emit += 8;
+    Byte (j, 0x4d); Byte (j, 0x8b); Byte (j, 0x04); Byte (j, 0x48); /* mov r8, [r8+rcx*2] */
+    Byte (j, 0x4d); Byte (j, 0x85); Byte (j, 0xc0);		/* test r8, r8 */
+    Byte (j, 0x74); Byte (j, 0); out[2] = j->emit;		/* jz */
+    Byte (j, 0x41); Byte (j, 0xff); Byte (j, 0xe0);		/* jmp r8 */
+    Land (j, out[0]); Land (j, out[1]); Land (j, out[2]);
+    Byte (j, 0xc3);						/* ret */
+}
+
+/* Go on to pc. */
+static void Leave (JitState *j, unsigned int pc) {
+    Byte (j, 0xb8); Word (j, pc);				/* mov eax, */
+    Chain (j);
+}
+
+/*
+ *  Block prologue: count its n instructions, unless that would go past
+ *  mips->stopAt, in which case hand the block at pc to the interpreter.
+ */
+static void Enter (JitState *j, unsigned int pc, int n) {
+    unsigned char *go;
+
+    Byte (j, 0x48); Byte (j, 0x8b); Byte (j, 0x87); Word (j, j->countDisp); /* mov rax, count */
+    Byte (j, 0x48); Byte (j, 0x05); Word (j, n);		/* add rax, n */
+    Byte (j, 0x48); Byte (j, 0x3b); Byte (j, 0x87); Word (j, j->stopDisp); /* cmp rax, stopAt */
+    Byte (j, 0x7e); Byte (j, 0); go = j->emit;			/* jle */
+    Return (j, pc);
+    Land (j, go);
+    Byte (j, 0x48); Byte (j, 0x89); Byte (j, 0x87); Word (j, j->countDisp); /* mov count, rax */
+}
+
+/*
+ *  Look up the address of the lw/sw d in the page table, leaving the
+ *  page in r8 and the offset into it in rcx. The checks' jumps to the
+ *  bail-out code go in toBail, terminated by NULL.
+ */
+static void CheckAddress (JitState *j, DecodedInstr *d, int store,
+  unsigned char **toBail) {
+    LoadReg (j, EAX, d->regs.i.rs);
+    Byte (j, 0x05); Word (j, d->regs.i.addr_or_immed);	/* add eax, imm */
+    Byte (j, 0xa8); Byte (j, 3);				/* test al, 3 */
+    Byte (j, 0x75); Byte (j, 0); *toBail++ = j->emit;	/* jnz */
+    Byte (j, 0x89); Byte (j, 0xc1);				/* mov ecx, eax */
+    Byte (j, 0xc1); Byte (j, 0xe9); Byte (j, 22);		/* shr ecx, 22 */
+    Byte (j, 0x4c); Byte (j, 0x8b); Byte (j, 0x04); Byte (j, 0xce); /* mov r8, [rsi+rcx*8] */
+    Byte (j, 0x4d); Byte (j, 0x85); Byte (j, 0xc0);		/* test r8, r8 */
+    Byte (j, 0x74); Byte (j, 0); *toBail++ = j->emit;	/* jz */
+    Byte (j, 0x89); Byte (j, 0xc1);				/* mov ecx, eax */
+    Byte (j, 0xc1); Byte (j, 0xe9); Byte (j, 12);		/* shr ecx, 12 */
+    Byte (j, 0x81); Byte (j, 0xe1); Word (j, 1023);		/* and ecx, 1023 */
+    Byte (j, 0x4d); Byte (j, 0x8b); Byte (j, 0x04); Byte (j, 0xc8); /* mov r8, [r8+rcx*8] */
+    Byte (j, 0x4d); Byte (j, 0x85); Byte (j, 0xc0);		/* test r8, r8 */
+    Byte (j, 0x74); Byte (j, 0); *toBail++ = j->emit;	/* jz */
+    if (store) {
+        Byte (j, 0x89); Byte (j, 0xc1);			/* mov ecx, eax */
+        Byte (j, 0x81); Byte (j, 0xe9); Word (j, j->textBase);	/* sub ecx, */
+        Byte (j, 0x81); Byte (j, 0xf9); Word (j, 4*j->textWords); /* cmp ecx, */
+        Byte (j, 0x72); Byte (j, 0); *toBail++ = j->emit;	/* jb */
+    }
+    Byte (j, 0x89); Byte (j, 0xc1);				/* mov ecx, eax */
+    Byte (j, 0x81); Byte (j, 0xe1); Word (j, 4*PAGEWORDS-4);	/* and ecx, */
+    *toBail = NULL;
+}
+
+/*
+ *  Close off a lw/sw: skip over the bail-out code, which comes next.
+ *  unrun is how many of the block's instructions, counting this one,
+ *  haven't happened if it bails.
+ */
+static void Bail (JitState *j, unsigned int pc, int unrun,
+  unsigned char **toBail) {
+    unsigned char *over;
+
+    Byte (j, 0xeb); Byte (j, 0); over = j->emit;		/* jmp */
+    for (; *toBail; toBail++) {
+        Land (j, *toBail);
+    }
+    Byte (j, 0xc7); Byte (j, 0x02); Word (j, 1);		/* mov dword [rdx], 1 */
+    Byte (j, 0x48); Byte (j, 0x81); Byte (j, 0x87);		/* add qword count, */
+    Word (j, j->countDisp); Word (j, -unrun);
+    Return (j, pc);
+    Land (j, over);
+}
+
+/*
+ *  Emit code for the instruction d at pc, the last unrun of the block
+ *  counting this one. Returns 1 if d ends the block.
+ */
+static int Translate1 (JitState *j, DecodedInstr *d, unsigned int pc,
+  int unrun) {
+    unsigned char *toBail[5];
+
+    switch (d->op) {
+        case 0:
+            switch (d->regs.r.funct) {
+                case 0:		/* sll */
+                    LoadReg (j, EAX, d->regs.r.rt);
+                    Byte (j, 0xc1); Byte (j, 0xe0); Byte (j, d->regs.r.shamt);
+                    StoreReg (j, d->regs.r.rd);
+                    break;
+                case 2:		/* srl */
+                    LoadReg (j, EAX, d->regs.r.rt);
+                    Byte (j, 0xc1); Byte (j, 0xe8); Byte (j, d->regs.r.shamt);
+                    StoreReg (j, d->regs.r.rd);
+                    break;
+                case 8:		/* jr */
+                    LoadReg (j, EAX, d->regs.r.rs);
+                    Byte (j, 0x3d); Word (j, pc);		/* cmp eax, pc */
+                    Byte (j, 0x74); Byte (j, 0); toBail[0] = j->emit;	/* je */
+                    toBail[1] = NULL;
+                    Bail (j, pc, unrun, toBail);
+                    Chain (j);
+                    return 1;
+                case 33:	/* addu */
+                case 35:	/* subu */
+                case 36:	/* and */
+                case 37:	/* or */
+                    LoadReg (j, EAX, d->regs.r.rs);
+                    LoadReg (j, ECX, d->regs.r.rt);
+                    Byte (j, d->regs.r.funct == 33 ? 0x01 :
+                             d->regs.r.funct == 35 ? 0x29 :
+                             d->regs.r.funct == 36 ? 0x21 : 0x09);
+                    Byte (j, 0xc8);				/* op eax, ecx */
+                    StoreReg (j, d->regs.r.rd);
+                    break;
+                case 42:	/* slt */
+                    LoadReg (j, EAX, d->regs.r.rs);
+                    LoadReg (j, ECX, d->regs.r.rt);
+                    Byte (j, 0x39); Byte (j, 0xc8);		/* cmp eax, ecx */
+                    Byte (j, 0x0f); Byte (j, 0x9c); Byte (j, 0xc0); /* setl al */
+                    Byte (j, 0x0f); Byte (j, 0xb6); Byte (j, 0xc0); /* movzx eax, al */
+                    StoreReg (j, d->regs.r.rd);
+                    break;
+                default:	/* ignored, as in the stages */
+                    break;
+            }
+            return 0;
+        case 2:		/* j */
+            Leave (j, d->regs.j.target);
+            return 1;
+        case 3:		/* jal */
+            Byte (j, 0xc7); Byte (j, 0x47); Byte (j, 4*31); Word (j, pc + 4);
+            Leave (j, d->regs.j.target);
+            return 1;
+        case 4:		/* beq */
+        case 5:		/* bne */
+            LoadReg (j, EAX, d->regs.i.rs);
+            LoadReg (j, ECX, d->regs.i.rt);
+            Byte (j, 0x39); Byte (j, 0xc8);			/* cmp eax, ecx */
+            Byte (j, 0xb8); Word (j, pc + 4);			/* mov eax, */
+            Byte (j, 0xb9); Word (j, d->regs.i.addr_or_immed);	/* mov ecx, */
+            Byte (j, 0x0f); Byte (j, d->op == 4 ? 0x44 : 0x45); Byte (j, 0xc1); /* cmove/cmovne */
+            Chain (j);
+            return 1;
+        case 9:		/* addiu */
+        case 12:	/* andi */
+        case 13:	/* ori */
+            LoadReg (j, EAX, d->regs.i.rs);
+            Byte (j, d->op == 9 ? 0x05 : d->op == 12 ? 0x25 : 0x0d);
+            Word (j, d->regs.i.addr_or_immed);
+            StoreReg (j, d->regs.i.rt);
+            return 0;
+        case 15:	/* lui */
+            Byte (j, 0xb8); Word (j, (unsigned int) d->regs.i.addr_or_immed << 16);
+            StoreReg (j, d->regs.i.rt);
+            return 0;
+        case 35:	/* lw */
+            CheckAddress (j, d, 0, toBail);
+            Byte (j, 0x41); Byte (j, 0x8b); Byte (j, 0x04); Byte (j, 0x08); /* mov eax, [r8+rcx] */
+            StoreReg (j, d->regs.i.rt);
+            Bail (j, pc, unrun, toBail);
+            return 0;
+        case 43:	/* sw */
+            CheckAddress (j, d, 1, toBail);
+            LoadReg (j, EAX, d->regs.i.rt);
+            Byte (j, 0x41); Byte (j, 0x89); Byte (j, 0x04); Byte (j, 0x08); /* mov [r8+rcx], eax */
+            Bail (j, pc, unrun, toBail);
+            return 0;
+    }
+    return 0;
+}
+
+/* Whether d transfers control, ending a basic block */
+static int IsControl (DecodedInstr *d) {
+    return d->op == 2 || d->op == 3 || d->op == 4 || d->op == 5
+        || (d->op == 0 && d->regs.r.funct == 8);
+}
+
+/* Whether d, at pc, is a beq, bne or j that can go to itself */
+static int IsSelfBranch (DecodedInstr *d, unsigned int pc) {
+    return (d->op == 2 && d->regs.j.target == pc)
+        || ((d->op == 4 || d->op == 5) && d->regs.i.addr_or_immed == pc);
+}
+
+/* Throw away all translated code. */
+static void Flush (JitState *j) {
+    memset (j->blocks, 0, j->textWords * sizeof(BlockFn));
+    memset (j->hits, 0, j->textWords * sizeof(int));
+    j->emit = j->codeBuf;
+}
+
+/*
+ *  Translate the block starting at text word k. Returns NULL if the
+ *  block is empty, i.e. it starts with an unsupported instruction or a
+ *  branch to itself.
+ */
+static BlockFn Translate (Computer* mips, JitState *j, int k) {
+    unsigned char *start;
+    unsigned int pc = j->textBase + 4*k;
+    int n, i;
+
+    if (j->emit + (JIT_MAXBLOCK+1)*JIT_MAXBYTES > j->codeBuf + JIT_CODESIZE) {
+        Flush (j);
+    }
+
+    /* Find the extent of the block first so the count can go up front */
+    for (n=0; n < JIT_MAXBLOCK && k+n < j->textWords
+         && IsSupported (&mips->decoded[k+n])
+         && !IsSelfBranch (&mips->decoded[k+n], pc + 4*n); n++) {
+        if (IsControl (&mips->decoded[k+n])) {
+            n++;
+            break;
+        }
+    }
+    if (n == 0) {
+        return NULL;
+    }
+
+    start = j->emit;
+    j->lengths[k] = n;
+    Enter (j, pc, n);
+    for (i=0; i<n; i++) {
+        if (Translate1 (j, &mips->decoded[k+i], pc + 4*i, n - i)) {
+            return (BlockFn) start;
+        }
+    }
+    Leave (j, pc + 4*n);
+    return (BlockFn) start;
+}
+
+/*
+ *  A block bailed out on the lw/sw at mips->pc. If that was only
+ *  because the page it addresses hasn't been allocated yet, allocate it
+ *  now so the block gets through next time. Mem() won't do it for a lw.
+ */
+static void Touch (Computer* mips) {
+    DecodedInstr *d;
+    unsigned int addr;
+
+    if (!IsText (mips, mips->pc)) {
+        return;
+    }
+    d = &mips->decoded[(mips->pc - mips->regions[SEG_TEXT].base) >> 2];
+    if (d->op == 35 || d->op == 43) {
+        addr = mips->registers[d->regs.i.rs] + d->regs.i.addr_or_immed;
+        if (PageOf (mips, addr) == NULL && IsMapped (mips, addr)) {
+            AllocPage (mips, addr);
+        }
+    }
+}
+
+/*
+ *  Run from mips->pc until the program stops or mips->instrCount
+ *  reaches mips->stopAt, translating hot blocks.
+ */
+void RunJit (Computer* mips) {
+    JitState *j = mips->jit;
+    int changedReg, changedMem, bailed, leader = 1, control;
+    unsigned int k, pc;
+
+    if (j == NULL) {
+        j = calloc (1, sizeof(JitState));
+        if (j == NULL) {
+            RunThreaded (mips);
+            return;
+        }
+        j->codeBuf = mmap (NULL, JIT_CODESIZE, PROT_READ|PROT_WRITE|PROT_EXEC,
+                           MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (j->codeBuf == MAP_FAILED) {
+            free (j);
+            RunThreaded (mips);
+            return;
+        }
+        j->textBase = mips->regions[SEG_TEXT].base;
+        j->textWords = mips->textWords;
+        j->blocks = calloc (j->textWords, sizeof(BlockFn));
+        j->lengths = calloc (j->textWords, sizeof(int));
+        j->hits = calloc (j->textWords, sizeof(int));
+        if (j->blocks == NULL || j->lengths == NULL || j->hits == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+        j->countDisp = (char *) &mips->instrCount - (char *) mips->registers;
+        j->stopDisp = (char *) &mips->stopAt - (char *) mips->registers;
+        Flush (j);
+        mips->jit = j;
+    }
+
+    while (mips->instrCount < mips->stopAt) {
+        k = ((unsigned int) mips->pc - j->textBase) >> 2;
+        if (k >= j->textWords || mips->pc % 4 != 0) {
+            control = 1;	/* executing data; never translated */
+        } else {
+            if (leader && j->blocks[k] == NULL && j->hits[k] < JIT_THRESHOLD
+                && ++j->hits[k] == JIT_THRESHOLD) {
+                j->blocks[k] = Translate (mips, j, k);
+            }
+            if (leader && j->blocks[k] != NULL
+                && mips->instrCount + j->lengths[k] <= mips->stopAt) {
+                bailed = 0;
+                mips->pc = j->blocks[k] (mips->registers, mips->pageDir, &bailed);
+                leader = !bailed;
+                if (bailed) {
+                    Touch (mips);
+                }
+                continue;
+            }
+            control = IsControl (&mips->decoded[k]);
+        }
+        pc = mips->pc;
+        if (!Step (mips, &changedReg, &changedMem)) {
+            return;
+        }
+        if (mips->pc == pc && changedReg == -1 && changedMem == -1
+            && mips->selfLoops) {
+            mips->halted = HALT_LOOP;	/* branched to itself */
+            return;
+        }
+        if (changedMem != -1 && IsText (mips, changedMem)) {
+            Flush (j);
+        }
+        leader = control;
+    }
+}
+
+/* Release the computer's translated code. */
+void FreeJit (Computer* mips) {
+    if (mips->jit != NULL) {
+        munmap (mips->jit->codeBuf, JIT_CODESIZE);
+        free (mips->jit->blocks);
+        free (mips->jit->lengths);
+        free (mips->jit->hits);
+        free (mips->jit);
+        mips->jit = NULL;
+    }
+}
+
+#else
+
+void RunJit (Computer* mips) {
+    RunThreaded (mips);
+}
+
+void FreeJit (Computer* mips) {
+}
+
+#endif
@@ -0,0 +1,276 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "computer.h"
+#include "lanes.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Lockstep engine for sweeps of one program over many inputs.
+ *
+ *  Up to LANES computers that start at the same pc form a group. The
+ *  group keeps their registers as 32 vectors of LANES words (GCC vector
+ *  extensions, so SSE2 by default and AVX2 where the CPU has it) and
+ *  runs each decoded instruction once for all of them: ALU ops are
+ *  single vector ops, lw and sw go lane by lane to each computer's own
+ *  memory. Control flow has to agree. When a branch or jr would send
+ *  lanes different ways, the smaller side (for jr, every lane not going
+ *  where the first one does) is split off: its registers, pc and count
+ *  are written back as they were before the instruction, and once the
+ *  group is done it finishes alone on its own engine. Anything else out
+ *  of the ordinary for a lane, such as a bad address, a store into the
+ *  text segment or an unsupported instruction, splits it off the same
+ *  way, so those cases are only ever handled by the ordinary engines. So
+ *  does a branch, j or jr to itself, which they may stop with HALT_LOOP.
+ *
+ *  The lanes must run the same text, as copies made with CopyComputer()
+ *  do; stores into it always split, so it stays the same throughout.
+ */
+
+typedef unsigned int Vec __attribute__ ((vector_size (4*LANES)));
+typedef int SignedVec __attribute__ ((vector_size (4*LANES)));
+
+typedef struct {
+    Computer *lane [LANES];
+    unsigned int live;		/* bit l: lane l is still in the group */
+    Vec reg [32];		/* reg[r][l] is lane l's register r */
+    unsigned int pc;
+    long steps;			/* instructions run in lockstep so far */
+} Group;
+
+/* Give lane l its state back, as of the start of the instruction at g->pc. */
+static void Split (Group *g, int l) {
+    Computer *c = g->lane[l];
+    int r;
+
+    for (r=0; r<32; r++) {
+        c->registers[r] = g->reg[r][l];
+    }
+    c->pc = g->pc;
+    c->instrCount += g->steps;
+    g->live &= ~(1u << l);
+}
+
+static void SplitMask (Group *g, unsigned int mask) {
+    int l;
+
+    for (l=0; l<LANES; l++) {
+        if (mask & (1u << l)) {
+            Split (g, l);
+        }
+    }
+}
+
+/* The live lanes where *v is nonzero */
+static unsigned int Mask (Group *g, SignedVec *v) {
+    unsigned int mask = 0;
+    int l;
+
+    for (l=0; l<LANES; l++) {
+        mask |= ((*v)[l] != 0) << l;
+    }
+    return mask & g->live;
+}
+
+/*
+ *  Of the live lanes, those in taken and the rest disagree; keep the
+ *  bigger side in the group. Returns whether the remaining lanes take
+ *  the branch.
+ */
+static int Diverge (Group *g, unsigned int taken) {
+    unsigned int notTaken = g->live & ~taken;
+
+    if (taken != 0 && notTaken != 0) {
+        if (__builtin_popcount (taken) >= __builtin_popcount (notTaken)) {
+            SplitMask (g, notTaken);
+        } else {
+            SplitMask (g, taken);
+        }
+    }
+    return (g->live & taken) != 0;
+}
+
+/*
+ *  Run the group until every lane has split off or it has run n
+ *  instructions. Built for AVX2 as well as the baseline, and the one
+ *  the CPU can run is picked when the program starts.
+ */
+__attribute__ ((target_clones ("avx2", "default")))
+static void RunGroup (Group *g, long n) {
+    Vec *reg = g->reg, loaded;
+    SignedVec differ;
+    DecodedInstr *d, *decoded = g->lane[__builtin_ctz (g->live)]->decoded;
+    Computer *c;
+    unsigned int k, l, addr, target, mask;
+    unsigned int textBase = g->lane[__builtin_ctz (g->live)]->regions[SEG_TEXT].base;
+    unsigned int textWords = g->lane[__builtin_ctz (g->live)]->textWords;
+    int imm, *page;
+
+    while (g->live != 0 && g->steps < n) {
+        k = (g->pc - textBase) >> 2;
+        if (k >= textWords || g->pc % 4 != 0) {
+            /* running data as code: leave it to the engines */
+            SplitMask (g, g->live);
+            break;
+        }
+        d = &decoded[k];
+        imm = d->regs.i.addr_or_immed;
+        switch (d->op) {
+            case 0:
+                switch (d->regs.r.funct) {
+                    case 0:
+                        reg[d->regs.r.rd] = reg[d->regs.r.rt] << d->regs.r.shamt;
+                        break;
+                    case 2:
+                        reg[d->regs.r.rd] = reg[d->regs.r.rt] >> d->regs.r.shamt;
+                        break;
+                    case 8:
+                        target = reg[d->regs.r.rs][__builtin_ctz (g->live)];
+                        if (target == g->pc) {
+                            SplitMask (g, g->live);
+                            continue;
+                        }
+                        differ = reg[d->regs.r.rs] != target;
+                        SplitMask (g, Mask (g, &differ));
+                        g->pc = target;
+                        g->steps++;
+                        continue;
+                    case 33:
+                        reg[d->regs.r.rd] = reg[d->regs.r.rs] + reg[d->regs.r.rt];
+                        break;
+                    case 35:
+                        reg[d->regs.r.rd] = reg[d->regs.r.rs] - reg[d->regs.r.rt];
+                        break;
+                    case 36:
+                        reg[d->regs.r.rd] = reg[d->regs.r.rs] & reg[d->regs.r.rt];
+                        break;
+                    case 37:
+                        reg[d->regs.r.rd] = reg[d->regs.r.rs] | reg[d->regs.r.rt];
+                        break;
+                    case 42:
+                        reg[d->regs.r.rd] = (Vec) ((SignedVec) reg[d->regs.r.rs]
+                                                   < (SignedVec) reg[d->regs.r.rt]) & 1;
+                        break;
+                }
+                g->pc += 4;
+                break;
+            case 2:
+                if (d->regs.j.target == g->pc) {
+                    SplitMask (g, g->live);
+                    continue;
+                }
+                g->pc = d->regs.j.target;
+                break;
+            case 3:
+                reg[31] = (Vec) {} + (g->pc + 4);
+                g->pc = d->regs.j.target;
+                break;
+            case 4:
+            case 5:
+                if (imm == g->pc) {
+                    SplitMask (g, g->live);
+                    continue;
+                }
+                differ = reg[d->regs.i.rs] != reg[d->regs.i.rt];
+                mask = Mask (g, &differ);
+                if (d->op == 4) {
+                    mask = g->live & ~mask;
+                }
+                if (Diverge (g, mask)) {
+                    g->pc = imm;
+                } else {
+                    g->pc += 4;
+                }
+                break;
+            case 9:
+                reg[d->regs.i.rt] = reg[d->regs.i.rs] + imm;
+                g->pc += 4;
+                break;
+            case 12:
+                reg[d->regs.i.rt] = reg[d->regs.i.rs] & imm;
+                g->pc += 4;
+                break;
+            case 13:
+                reg[d->regs.i.rt] = reg[d->regs.i.rs] | imm;
+                g->pc += 4;
+                break;
+            case 15:
+                reg[d->regs.i.rt] = (Vec) {} + ((unsigned int) imm << 16);
+                g->pc += 4;
+                break;
+            case 35:
+                loaded = reg[d->regs.i.rt];
+                for (l=0; l<LANES; l++) {
+                    if (!(g->live & (1u << l))) {
+                        continue;
+                    }
+                    c = g->lane[l];
+                    addr = reg[d->regs.i.rs][l] + imm;
+                    page = PageOf (c, addr);
+                    if (page != NULL && addr % 4 == 0) {
+                        loaded[l] = page[(addr >> 2) & 1023];
+                    } else if (addr % 4 == 0 && IsMapped (c, addr)) {
+                        loaded[l] = 0;
+                    } else {
+                        Split (g, l);
+                    }
+                }
+                reg[d->regs.i.rt] = loaded;
+                g->pc += 4;
+                break;
+            case 43:
+                for (l=0; l<LANES; l++) {
+                    if (!(g->live & (1u << l))) {
+                        continue;
+                    }
+                    c = g->lane[l];
+                    addr = reg[d->regs.i.rs][l] + imm;
+                    if (addr % 4 != 0 || IsText (c, addr) || !IsMapped (c, addr)) {
+                        Split (g, l);
+                    } else {
+                        WriteWord (c, addr, reg[d->regs.i.rt][l]);
+                    }
+                }
+                g->pc += 4;
+                break;
+            default:
+                SplitMask (g, g->live);
+                continue;
+        }
+        g->steps++;
+    }
+}
+
+/*
+ *  Run at most n more instructions on each of the computers, as
+ *  StepN() would, taking them LANES at a time.
+ */
+void RunLanes (Computer *lanes, int numLanes, long n) {
+    Group g;
+    long start [LANES];
+    int first, l, r;
+
+    for (first=0; first<numLanes; first+=LANES) {
+        g.live = 0;
+        g.steps = 0;
+        g.pc = lanes[first].pc;
+        for (l=0; l<LANES && first+l<numLanes; l++) {
+            g.lane[l] = &lanes[first+l];
+            start[l] = lanes[first+l].instrCount;
+            if (lanes[first+l].halted == RUNNING && lanes[first+l].pc == g.pc) {
+                g.live |= 1u << l;
+                for (r=0; r<32; r++) {
+                    g.reg[r][l] = lanes[first+l].registers[r];
+                }
+            }
+        }
+        if (g.live != 0) {
+            RunGroup (&g, n);
+            SplitMask (&g, g.live);
+        }
+
+        /* Finish the lanes that split off */
+        for (l=0; l<LANES && first+l<numLanes; l++) {
+            StepN (g.lane[l], n - (g.lane[l]->instrCount - start[l]));
+        }
+    }
+}
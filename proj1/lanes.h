@@ -0,0 +1,9 @@
+/*
+ *  Lane-parallel execution: many copies of one program, differing only
+ *  in their data, run in lockstep with each instruction done for all of
+ *  them at once. Include computer.h first.
+ */
+
+#define LANES 8			/* computers run in lockstep together */
+
+void RunLanes (Computer *lanes, int numLanes, long n);
@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+#include "loop.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Repeats are found with Brent's method: one earlier state is kept,
+ *  and after each instruction the computer is compared with it. If
+ *  span instructions go by without a match, the current state is kept
+ *  instead and span doubles, up to LOOP_SPAN; so a loop of up to that
+ *  many instructions is caught within about twice its length, plus
+ *  LOOP_SPAN, of starting.
+ *
+ *  Comparing is cheap because nothing else happens unless the pc
+ *  matches. The registers, HI, LO and the heap break are then compared
+ *  outright, and memory by a 64-bit hash of every nonzero word that is
+ *  kept up to date as the stores happen, so telling two memories apart
+ *  comes down to that hash, with a chance of about 2^-64 of getting it
+ *  wrong.
+ */
+
+struct LoopCheck {
+    unsigned long long memHash;	/* of all of memory, as of now */
+    int stale;			/* memory changed behind its back */
+    long since;			/* instruction count of the state kept: */
+    int pc, hi, lo;
+    unsigned int heapBreak;
+    int registers [32];
+    unsigned long long memAt;
+    long span;			/* how long to look for it before moving on */
+    long compares;		/* times the pc matched and the rest was compared */
+    long stuckAt, period;	/* when the repeat was found, and its length */
+};
+
+/* The part word addr holding value plays in the memory hash */
+static unsigned long long Mix (unsigned int addr, int value) {
+    unsigned long long x = (unsigned long long) addr << 32 | (unsigned int) value;
+
+    if (value == 0) {
+        return 0;		/* so untouched memory needn't be visited */
+    }
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static void HashMemory (LoopCheck *l, Computer* mips) {
+    unsigned int base;
+    int p, k, *page;
+
+    l->memHash = 0;
+    for (p=0; p<mips->numPages; p++) {
+        base = (unsigned int) mips->pageList[p] << 12;
+        page = PageOf (mips, base);
+        for (k=0; k<PAGEWORDS; k++) {
+            l->memHash ^= Mix (base + 4*k, page[k]);
+        }
+    }
+}
+
+/* Keep the computer's state as it is now */
+static void Keep (LoopCheck *l, Computer* mips) {
+    l->since = mips->instrCount;
+    l->pc = mips->pc;
+    l->hi = mips->hi;
+    l->lo = mips->lo;
+    l->heapBreak = mips->heapBreak;
+    memcpy (l->registers, mips->registers, sizeof(l->registers));
+    l->memAt = l->memHash;
+}
+
+LoopCheck *NewLoopCheck (Computer* mips) {
+    LoopCheck *l = calloc (1, sizeof(LoopCheck));
+
+    if (l == NULL) {
+        return NULL;
+    }
+    HashMemory (l, mips);
+    Keep (l, mips);
+    l->span = 1;
+    return l;
+}
+
+/* Account for a store changing the word at addr from old to new. */
+void LoopStore (LoopCheck *l, unsigned int addr, int old, int new) {
+    l->memHash ^= Mix (addr, old) ^ Mix (addr, new);
+}
+
+/*
+ *  Look at the computer after the instruction at pc ran, changing
+ *  changedReg and changedMem as for PrintInfo(), and stop it with
+ *  HALT_LOOP if it is stuck.
+ */
+void LoopStep (LoopCheck *l, Computer* mips, unsigned int pc, int changedReg,
+  int changedMem) {
+    long period = 0;
+
+    if (l->stale) {
+        HashMemory (l, mips);
+        Keep (l, mips);
+        l->span = 1;
+        l->stale = 0;
+        return;
+    }
+    if (mips->pc == pc && changedReg == -1 && changedMem == -1) {
+        period = 1;		/* branched to itself */
+    } else if (mips->pc == l->pc) {
+        l->compares++;
+        if (l->memHash == l->memAt && mips->hi == l->hi && mips->lo == l->lo
+            && mips->heapBreak == l->heapBreak
+            && memcmp (mips->registers, l->registers, sizeof(l->registers)) == 0) {
+            period = mips->instrCount - l->since;
+        }
+    }
+    if (period > 0) {
+        l->stuckAt = mips->instrCount;
+        l->period = period;
+        mips->halted = HALT_LOOP;
+        return;
+    }
+    if (mips->instrCount - l->since >= l->span) {
+        Keep (l, mips);
+        if (l->span < LOOP_SPAN) {
+            l->span *= 2;
+        }
+    }
+}
+
+/*
+ *  Forget what has been seen, after the computer was changed some other
+ *  way than by running forward, such as by going back.
+ */
+void RestartLoopCheck (LoopCheck *l) {
+    l->stale = 1;
+    l->stuckAt = l->period = 0;
+}
+
+void PrintLoopCheck (LoopCheck *l) {
+    if (l->stuckAt == 0) {
+        return;
+    }
+    printf ("Loop: after %ld instructions the state repeats every %ld\n",
+            l->stuckAt - l->period, l->period);
+    printf ("  (%ld full comparisons)\n", l->compares);
+}
+
+void FreeLoopCheck (LoopCheck *l) {
+    free (l);
+}
@@ -0,0 +1,18 @@
+/*
+ *  Spotting a program that can only repeat itself: an instruction that
+ *  branches to itself and changes nothing, or the whole state (pc,
+ *  registers, HI and LO, and memory) coming back to what it was at an
+ *  earlier instruction. Such a run is stopped with HALT_LOOP. Include
+ *  computer.h first.
+ */
+
+#define LOOP_SPAN (1 << 20)	/* longest repeat looked for, in instructions */
+
+typedef struct LoopCheck LoopCheck;
+
+LoopCheck *NewLoopCheck (Computer*);
+void LoopStore (LoopCheck*, unsigned int addr, int old, int new);
+void LoopStep (LoopCheck*, Computer*, unsigned int pc, int changedReg, int changedMem);
+void RestartLoopCheck (LoopCheck*);
+void PrintLoopCheck (LoopCheck*);
+void FreeLoopCheck (LoopCheck*);
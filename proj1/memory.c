@@ -0,0 +1,279 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "computer.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  The simulated address space.
+ *
+ *  Pages are carved out of anonymous mappings of ARENAPAGES pages at a
+ *  time, so the kernel supplies them zeroed and only as they are
+ *  touched; nothing is cleared up front however big the regions are.
+ *  Each page also gets a bitmap of its nonzero words, which WriteWord()
+ *  keeps current so -m can print memory without scanning it. Engines
+ *  that store straight into pages call ScanMemory() afterwards.
+ */
+
+#define ARENAPAGES 64		/* pages per anonymous mapping */
+
+struct Mapping {
+    void *addr;
+    size_t len;
+};
+
+/*
+ *  Set up the regions for the given layout, with no pages allocated.
+ *  The text region starts out one page long; the loader extends it to
+ *  fit the program. mips must not own any memory yet.
+ */
+void InitMemory (Computer* mips, Layout layout) {
+    Region *r = mips->regions;
+
+    memset (mips->pageDir, 0, sizeof(mips->pageDir));
+    mips->layout = layout;
+    mips->pageList = NULL;
+    mips->numPages = mips->maxPages = 0;
+    mips->mappings = NULL;
+    mips->numMappings = mips->maxMappings = 0;
+    mips->arenaNext = NULL;
+    mips->arenaLeft = 0;
+    mips->textWords = 0;
+    mips->decoded = NULL;
+
+    if (layout == LAYOUT_SPIM) {
+        r[SEG_TEXT].base = 0x00400000;
+        r[SEG_TEXT].limit = 0x00401000;
+        r[SEG_DATA].base = 0x10000000;
+        r[SEG_DATA].limit = 0x10400000;
+        r[SEG_HEAP].base = r[SEG_HEAP].limit = 0x10400000;
+        r[SEG_STACK].base = 0x7f800000;
+        r[SEG_STACK].limit = 0x80000000;
+    } else {
+        r[SEG_TEXT].base = 0x00400000;
+        r[SEG_TEXT].limit = 0x00400000 + 4*MAXNUMINSTRS;
+        r[SEG_DATA].base = r[SEG_TEXT].limit;
+        r[SEG_DATA].limit = r[SEG_DATA].base + 4*MAXNUMDATA;
+        r[SEG_HEAP].base = r[SEG_HEAP].limit = r[SEG_DATA].limit;
+        r[SEG_STACK].base = r[SEG_STACK].limit = r[SEG_DATA].limit;
+    }
+}
+
+/* Give back everything InitMemory() and the pages took. */
+void FreeMemory (Computer* mips) {
+    int k, d;
+
+    for (k=0; k<mips->numMappings; k++) {
+        munmap (mips->mappings[k].addr, mips->mappings[k].len);
+    }
+    for (d=0; d<1024; d++) {
+        if (mips->pageDir[d] != NULL) {
+            for (k=0; k<1024; k++) {
+                free (mips->pageDir[d]->nonzero[k]);
+            }
+            free (mips->pageDir[d]);
+            mips->pageDir[d] = NULL;
+        }
+    }
+    free (mips->mappings);
+    free (mips->pageList);
+    free (mips->decoded);
+    mips->mappings = NULL;
+    mips->pageList = NULL;
+    mips->decoded = NULL;
+    mips->numMappings = mips->maxMappings = 0;
+    mips->numPages = mips->maxPages = 0;
+    mips->arenaLeft = 0;
+}
+
+/* Whether addr is a word-aligned address in one of the regions */
+int IsMapped (Computer* mips, unsigned int addr) {
+    int k;
+
+    if (addr % 4 != 0) {
+        return 0;
+    }
+    for (k=0; k<NUMSEGS; k++) {
+        if (addr >= mips->regions[k].base && addr < mips->regions[k].limit) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* Whether addr is in the text region */
+int IsText (Computer* mips, unsigned int addr) {
+    return addr - mips->regions[SEG_TEXT].base
+        < mips->regions[SEG_TEXT].limit - mips->regions[SEG_TEXT].base;
+}
+
+/* Remember a mapping so FreeMemory() will undo it. */
+void AddMapping (Computer* mips, void *addr, size_t len) {
+    if (mips->numMappings == mips->maxMappings) {
+        mips->maxMappings = mips->maxMappings ? 2*mips->maxMappings : 16;
+        mips->mappings = realloc (mips->mappings,
+                                  mips->maxMappings * sizeof(struct Mapping));
+        if (mips->mappings == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    mips->mappings[mips->numMappings].addr = addr;
+    mips->mappings[mips->numMappings].len = len;
+    mips->numMappings++;
+}
+
+/*
+ *  Use page, 4 KiB that stays valid until FreeMemory(), as the page
+ *  holding addr, which must be mapped and not have a page yet. bits is
+ *  the page's bitmap of nonzero words, or NULL if it is all zero.
+ */
+void InstallPage (Computer* mips, unsigned int addr, int *page,
+  const unsigned long long *bits) {
+    PageTable *t = mips->pageDir[addr >> 22];
+    unsigned long long *nonzero;
+    int k, n = addr >> 12;
+
+    if (t == NULL) {
+        t = mips->pageDir[addr >> 22] = calloc (1, sizeof(PageTable));
+    }
+    nonzero = calloc (PAGEWORDS/64, sizeof(unsigned long long));
+    if (t == NULL || nonzero == NULL) {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+    }
+    t->words[n & 1023] = page;
+    t->nonzero[n & 1023] = nonzero;
+    if (bits != NULL) {
+        memcpy (nonzero, bits, PAGEWORDS/64 * sizeof(unsigned long long));
+    }
+
+    /* Keep pageList in address order for PrintNonzero() */
+    if (mips->numPages == mips->maxPages) {
+        mips->maxPages = mips->maxPages ? 2*mips->maxPages : 16;
+        mips->pageList = realloc (mips->pageList, mips->maxPages * sizeof(int));
+        if (mips->pageList == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    for (k=mips->numPages; k>0 && mips->pageList[k-1] > n; k--) {
+        mips->pageList[k] = mips->pageList[k-1];
+    }
+    mips->pageList[k] = n;
+    mips->numPages++;
+}
+
+/*
+ *  Allocate a zeroed page for addr, which must be mapped and not have a
+ *  page yet, and return it.
+ */
+int *AllocPage (Computer* mips, unsigned int addr) {
+    int *page;
+
+    if (mips->arenaLeft == 0) {
+        mips->arenaNext = mmap (NULL, ARENAPAGES*4*PAGEWORDS, PROT_READ|PROT_WRITE,
+                                MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+        if (mips->arenaNext == MAP_FAILED) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+        AddMapping (mips, mips->arenaNext, ARENAPAGES*4*PAGEWORDS);
+        mips->arenaLeft = ARENAPAGES;
+    }
+    page = (int *) mips->arenaNext;
+    mips->arenaNext += 4*PAGEWORDS;
+    mips->arenaLeft--;
+    InstallPage (mips, addr, page, NULL);
+    return page;
+}
+
+/*
+ *  Put the word at addr in *value. Returns 0 if addr isn't a mapped
+ *  word address.
+ */
+int ReadWord (Computer* mips, unsigned int addr, int *value) {
+    int *page = PageOf (mips, addr);
+
+    if (page != NULL && addr % 4 == 0) {
+        *value = page[(addr >> 2) & 1023];
+        return 1;
+    }
+    if (!IsMapped (mips, addr)) {
+        return 0;
+    }
+    *value = 0;
+    return 1;
+}
+
+/*
+ *  Store value at addr, allocating its page if need be. Returns 0 if
+ *  addr isn't a mapped word address.
+ */
+int WriteWord (Computer* mips, unsigned int addr, int value) {
+    int *page = PageOf (mips, addr);
+    unsigned long long *nonzero;
+    int k = (addr >> 2) & 1023;
+
+    if (addr % 4 != 0 || (page == NULL && !IsMapped (mips, addr))) {
+        return 0;
+    }
+    if (page == NULL) {
+        page = AllocPage (mips, addr);
+    }
+    page[k] = value;
+    nonzero = mips->pageDir[addr >> 22]->nonzero[(addr >> 12) & 1023];
+    if (value != 0) {
+        nonzero[k/64] |= 1ULL << (k%64);
+    } else {
+        nonzero[k/64] &= ~(1ULL << (k%64));
+    }
+    return 1;
+}
+
+/* Rebuild every page's nonzero bitmap, for engines that bypass WriteWord(). */
+void ScanMemory (Computer* mips) {
+    int p, k, n;
+    int *page;
+    unsigned long long *nonzero;
+
+    for (p=0; p<mips->numPages; p++) {
+        n = mips->pageList[p];
+        page = mips->pageDir[n >> 10]->words[n & 1023];
+        nonzero = mips->pageDir[n >> 10]->nonzero[n & 1023];
+        memset (nonzero, 0, PAGEWORDS/64 * sizeof(unsigned long long));
+        for (k=0; k<PAGEWORDS; k++) {
+            if (page[k] != 0) {
+                nonzero[k/64] |= 1ULL << (k%64);
+            }
+        }
+    }
+}
+
+/*
+ *  Print the nonzero words outside of the text region in address order.
+ *  Only allocated pages and their set bits are looked at.
+ */
+void PrintNonzero (Computer* mips) {
+    int p, k, bit, n;
+    unsigned int addr;
+    unsigned long long bits, *nonzero;
+
+    printf ("Nonzero memory\n");
+    printf ("ADDR	  CONTENTS\n");
+    for (p=0; p<mips->numPages; p++) {
+        n = mips->pageList[p];
+        if (IsText (mips, (unsigned int) n << 12)) {
+            continue;
+        }
+        nonzero = mips->pageDir[n >> 10]->nonzero[n & 1023];
+        for (k=0; k<PAGEWORDS/64; k++) {
+            for (bits = nonzero[k]; bits != 0; bits &= bits - 1) {
+                bit = __builtin_ctzll (bits);
+                addr = ((unsigned int) n << 12) + 4*(64*k + bit);
+                printf ("%8.8x  %8.8x\n", addr, Fetch (mips, addr));
+            }
+        }
+    }
+}
@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+#include "ooo.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  The model works out, for each instruction in program order, the
+ *  cycles in which it is dispatched, issued, completes and commits:
+ *
+ *    - Dispatch is in order, width a cycle, one cycle after the one
+ *      width before it at the earliest. It also needs a free ROB entry,
+ *      which the instruction rob before it frees the cycle after it
+ *      commits, and a free reservation station, which an instruction
+ *      frees the cycle after it issues.
+ *    - Registers are renamed, so only true dependences wait: an
+ *      instruction can issue once every source's value is ready, in the
+ *      cycle after dispatch at the earliest, and then in the first cycle
+ *      with an issue slot and a free unit of its kind. HI and LO are
+ *      renamed as one register. A load also waits for the latest store
+ *      to the same word, whose value it gets forwarded; otherwise loads
+ *      may pass stores.
+ *    - Results are ready latency cycles after issue: 1 for the ALU and
+ *      for stores, and as configured for loads, mult and div. Only the
+ *      multiply/divide unit's div isn't pipelined.
+ *    - Commit is in order, width a cycle, once complete.
+ *
+ *  The front end is ideal: branches are predicted perfectly and fetch
+ *  always keeps up. Register 0 is never waited on. The run takes until
+ *  the last commit.
+ *
+ *  Units are booked in a calendar of future cycles, a ring long enough
+ *  to cover everything a full ROB could have in flight.
+ */
+
+enum { FU_ALU=0, FU_MULDIV, FU_MEM, NUMFUS };
+
+#define HILO 32			/* renamed register for HI and LO */
+#define STORES 1024		/* recent stores remembered for forwarding */
+
+typedef struct {
+    long cycle;			/* which cycle the counts are for */
+    int issued;
+    int busy [NUMFUS];
+} Slot;
+
+struct Ooo {
+    OooConfig config;
+    int units [NUMFUS];
+    long ready [33];		/* cycle each register's latest value is ready */
+    long *dispatched;		/* dispatch cycles of the latest width instructions */
+    long *committed;		/* commit cycles of the latest rob instructions */
+    long *waiting;		/* issue cycles of those in the stations, a min-heap */
+    int numWaiting;
+    Slot *slots;		/* the calendar */
+    long slotMask;
+    struct {
+        unsigned int addr;
+        long ready;
+    } stores [STORES];
+    long lastDispatch, lastCommit;
+    long instructions;
+    long robStalls;		/* dispatch cycles lost to a full ROB */
+    long rsStalls;		/* ... and to full reservation stations */
+    long operandWaits;		/* cycles instructions sat waiting for operands */
+    long unitWaits;		/* ... and ready, for an issue slot or unit */
+};
+
+/*
+ *  Fill in config from a -o argument: "default", or comma-separated
+ *  settings such as "width=4,rob=128". Returns -1 if it isn't one.
+ */
+int ParseOoo (const char *spec, OooConfig *config) {
+    static const char *keys[] = { "width", "rob", "rs", "alus", "ports",
+                                  "load", "mul", "div", NULL };
+    int *fields[] = { &config->width, &config->rob, &config->rs, &config->alus,
+                      &config->ports, &config->loadLatency, &config->mulLatency,
+                      &config->divLatency };
+    int k, len;
+    char *end;
+
+    config->width = 4;
+    config->rob = 128;
+    config->rs = 48;
+    config->alus = 4;
+    config->ports = 2;
+    config->loadLatency = 3;
+    config->mulLatency = 4;
+    config->divLatency = 20;
+    if (strcmp (spec, "default") == 0) {
+        return 0;
+    }
+
+    while (1) {
+        for (k=0; keys[k] != NULL; k++) {
+            len = strlen (keys[k]);
+            if (strncmp (spec, keys[k], len) == 0 && spec[len] == '=') {
+                break;
+            }
+        }
+        if (keys[k] == NULL) {
+            return -1;
+        }
+        *fields[k] = strtol (spec + len + 1, &end, 10);
+        if (end == spec + len + 1 || *fields[k] < 1 || *fields[k] > 4096) {
+            return -1;
+        }
+        if (*end == '\0') {
+            break;
+        } else if (*end != ',') {
+            return -1;
+        }
+        spec = end + 1;
+    }
+    if (config->width > config->rob || config->loadLatency > 100
+        || config->mulLatency > 100 || config->divLatency > 100) {
+        return -1;
+    }
+    return 0;
+}
+
+Ooo *NewOoo (OooConfig *config) {
+    Ooo *o = calloc (1, sizeof(Ooo));
+    long span = config->loadLatency;
+    int k;
+
+    if (o == NULL) {
+        return NULL;
+    }
+    o->config = *config;
+    o->units[FU_ALU] = config->alus;
+    o->units[FU_MULDIV] = 1;
+    o->units[FU_MEM] = config->ports;
+
+    /* Every instruction in flight could be waiting on a div before it */
+    if (config->mulLatency > span) {
+        span = config->mulLatency;
+    }
+    if (config->divLatency > span) {
+        span = config->divLatency;
+    }
+    span = 2 * (config->rob + config->rs) * (span + 1);
+    for (o->slotMask = 1; o->slotMask < span; o->slotMask *= 2)
+        ;
+    o->dispatched = calloc (config->width, sizeof(long));
+    o->committed = calloc (config->rob, sizeof(long));
+    o->waiting = calloc (config->rs, sizeof(long));
+    o->slots = calloc (o->slotMask, sizeof(Slot));
+    if (o->dispatched == NULL || o->committed == NULL || o->waiting == NULL
+        || o->slots == NULL) {
+        FreeOoo (o);
+        return NULL;
+    }
+    o->slotMask--;
+    for (k=0; k<=o->slotMask; k++) {
+        o->slots[k].cycle = -1;
+    }
+    for (k=0; k<config->width; k++) {
+        o->dispatched[k] = -1;
+    }
+    for (k=0; k<config->rob; k++) {
+        o->committed[k] = -1;
+    }
+    return o;
+}
+
+/* The calendar's counts for cycle c */
+static Slot *SlotAt (Ooo *o, long c) {
+    Slot *s = &o->slots[c & o->slotMask];
+
+    if (s->cycle != c) {
+        memset (s, 0, sizeof(Slot));
+        s->cycle = c;
+    }
+    return s;
+}
+
+/*
+ *  Whether an instruction needing unit fu for busy cycles can issue in
+ *  cycle c; if so, book it.
+ */
+static int Book (Ooo *o, long c, int fu, int busy) {
+    int k;
+
+    if (SlotAt (o, c)->issued == o->config.width) {
+        return 0;
+    }
+    for (k=0; k<busy; k++) {
+        if (SlotAt (o, c+k)->busy[fu] == o->units[fu]) {
+            return 0;
+        }
+    }
+    SlotAt (o, c)->issued++;
+    for (k=0; k<busy; k++) {
+        SlotAt (o, c+k)->busy[fu]++;
+    }
+    return 1;
+}
+
+/* Add issue cycle c to the reservation stations' heap */
+static void PushWaiting (Ooo *o, long c) {
+    int k = o->numWaiting++;
+
+    while (k > 0 && o->waiting[(k-1)/2] > c) {
+        o->waiting[k] = o->waiting[(k-1)/2];
+        k = (k-1)/2;
+    }
+    o->waiting[k] = c;
+}
+
+/* Remove the earliest issue cycle from the heap */
+static void PopWaiting (Ooo *o) {
+    long c = o->waiting[--o->numWaiting];
+    int k = 0, child;
+
+    while ((child = 2*k + 1) < o->numWaiting) {
+        if (child + 1 < o->numWaiting && o->waiting[child+1] < o->waiting[child]) {
+            child++;
+        }
+        if (o->waiting[child] >= c) {
+            break;
+        }
+        o->waiting[k] = o->waiting[child];
+        k = child;
+    }
+    o->waiting[k] = c;
+}
+
+/*
+ *  Account for d having been executed; addr is the address it loaded
+ *  from or stored to, if it did either.
+ */
+void OooStep (Ooo *o, DecodedInstr *d, unsigned int addr) {
+    OooConfig *config = &o->config;
+    int srcs[3], n, k, dest, fu = FU_ALU, latency = 1, busy = 1;
+    long c, free, issue, ready, complete, commit;
+    const InstrInfo *info = d->info;
+    int store = STORES, h = (addr >> 2) % STORES;
+
+    /* Dispatch */
+    c = o->dispatched[o->instructions % config->width] + 1;
+    if (c < o->lastDispatch) {
+        c = o->lastDispatch;
+    }
+    free = o->committed[o->instructions % config->rob] + 1;
+    if (free > c) {
+        o->robStalls += free - c;
+        c = free;
+    }
+    while (o->numWaiting > 0 && o->waiting[0] < c) {
+        PopWaiting (o);
+    }
+    if (o->numWaiting == config->rs) {
+        o->rsStalls += o->waiting[0] + 1 - c;
+        c = o->waiting[0] + 1;
+        while (o->numWaiting > 0 && o->waiting[0] < c) {
+            PopWaiting (o);
+        }
+    }
+    o->dispatched[o->instructions % config->width] = c;
+    o->lastDispatch = c;
+
+    /* What it needs */
+    n = SourceRegs (d, srcs);
+    if (info->name != NULL && strncmp (info->name, "mf", 2) == 0) {
+        srcs[n++] = HILO;
+    }
+    if (info->mem != M_NONE) {
+        fu = FU_MEM;
+        if (info->mem < M_SB) {
+            latency = config->loadLatency;
+            if (o->stores[h].addr == (addr & ~3)) {
+                store = h;
+            }
+        }
+    } else if (info->wb == W_HILO && info->name[1] != 't') {
+        fu = FU_MULDIV;
+        if (info->name[0] == 'd') {
+            latency = busy = config->divLatency;
+        } else {
+            latency = config->mulLatency;
+        }
+    }
+
+    /* Issue */
+    ready = c + 1;
+    for (k=0; k<n; k++) {
+        if (srcs[k] != 0 && o->ready[srcs[k]] > ready) {
+            ready = o->ready[srcs[k]];
+        }
+    }
+    if (store < STORES && o->stores[store].ready > ready) {
+        ready = o->stores[store].ready;
+    }
+    o->operandWaits += ready - (c + 1);
+    for (issue = ready; !Book (o, issue, fu, busy); issue++)
+        ;
+    o->unitWaits += issue - ready;
+    PushWaiting (o, issue);
+    complete = issue + latency;
+
+    dest = DestReg (d);
+    if (dest > 0) {
+        o->ready[dest] = complete;
+    } else if (info->wb == W_HILO) {
+        o->ready[HILO] = complete;
+    }
+    if (info->mem >= M_SB) {
+        o->stores[h].addr = addr & ~3;
+        o->stores[h].ready = complete;
+    }
+
+    /* Commit */
+    commit = complete > o->lastCommit ? complete : o->lastCommit;
+    if (o->instructions >= config->width) {
+        k = (o->instructions - config->width) % config->rob;
+        if (commit <= o->committed[k]) {
+            commit = o->committed[k] + 1;
+        }
+    }
+    o->committed[o->instructions % config->rob] = commit;
+    o->lastCommit = commit;
+    o->instructions++;
+}
+
+void PrintOoo (Ooo *o) {
+    OooConfig *config = &o->config;
+    long cycles = o->instructions ? o->lastCommit + 1 : 0;
+
+    printf ("Out-of-order core: %d wide, %d ROB entries, %d reservation stations,\n",
+            config->width, config->rob, config->rs);
+    printf ("  %d ALUs, %d load/store ports; load %d, mult %d, div %d cycles\n",
+            config->alus, config->ports, config->loadLatency,
+            config->mulLatency, config->divLatency);
+    printf ("Cycles: %ld\n", cycles);
+    printf ("Instructions: %ld\n", o->instructions);
+    printf ("IPC: %.3f\n", cycles ? (double) o->instructions / cycles : 0.0);
+    printf ("Dispatch stalls: %ld\n", o->robStalls + o->rsStalls);
+    printf ("  ROB full      %ld\n", o->robStalls);
+    printf ("  RS full       %ld\n", o->rsStalls);
+    printf ("Waiting in the stations, summed over instructions:\n");
+    printf ("  dependencies  %ld\n", o->operandWaits);
+    printf ("  issue/units   %ld\n", o->unitWaits);
+}
+
+void FreeOoo (Ooo *o) {
+    free (o->dispatched);
+    free (o->committed);
+    free (o->waiting);
+    free (o->slots);
+    free (o);
+}
@@ -0,0 +1,25 @@
+/*
+ *  Cycle-level timing of a superscalar out-of-order core: in-order
+ *  dispatch into a reorder buffer and reservation stations, renamed
+ *  registers, issue to functional units as operands become ready, and
+ *  in-order commit. Driven by the instructions the stages actually
+ *  execute, like the 5-stage model in pipeline.h. Include computer.h
+ *  first.
+ */
+
+typedef struct {
+    int width;			/* dispatched, issued and committed per cycle */
+    int rob;			/* reorder buffer entries */
+    int rs;			/* reservation station entries, for all units */
+    int alus;			/* ALUs, which also resolve branches and jumps */
+    int ports;			/* load/store ports */
+    int loadLatency, mulLatency, divLatency;
+} OooConfig;
+
+typedef struct Ooo Ooo;
+
+int ParseOoo (const char *spec, OooConfig*);
+Ooo *NewOoo (OooConfig*);
+void OooStep (Ooo*, DecodedInstr*, unsigned int addr);
+void PrintOoo (Ooo*);
+void FreeOoo (Ooo*);
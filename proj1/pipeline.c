@@ -0,0 +1,163 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+#include "pipeline.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  The model keeps, for each register, the EX cycle of the last
+ *  instruction that wrote it and whether that was a lw. An instruction
+ *  enters EX one cycle after the one before it, plus any control
+ *  penalty that one left behind, and then as many cycles later as it
+ *  takes for all of its sources to be readable:
+ *
+ *    - through EX/MEM, in the cycle right after an ALU result's EX;
+ *    - through MEM/WB, two cycles after, for an ALU result or a load;
+ *    - from the register file, whose write in WB comes before the read
+ *      in ID of the same cycle, from three cycles after on.
+ *
+ *  Branches are predicted not taken and resolved in EX, so a taken beq
+ *  or bne costs two fetched-and-flushed instructions, as does jr. j and
+ *  jal are redirected in ID for one. Register 0 never causes a stall.
+ *  The first instruction is in EX in cycle 3; the run ends when the
+ *  last one leaves WB.
+ */
+
+#define NEVER (-100)		/* EX cycle of a register nobody has written */
+
+struct Pipeline {
+    int forwarding;
+    long nextEx;		/* earliest EX cycle for the next instruction */
+    long lastEx;		/* EX cycle of the latest instruction */
+    long writerEx [32];		/* EX cycle of each register's last writer */
+    char writerLoad [32];	/* whether that writer was a lw */
+    long instructions;
+    long loadUseStalls;		/* cycles waiting on a lw's result */
+    long dataStalls;		/* cycles waiting on an ALU result */
+    long branchStalls;		/* cycles flushed after taken beq/bne */
+    long jumpStalls;		/* cycles flushed after j, jal, jr */
+    long branches, taken;
+    int flushBranch, flushJump;	/* penalty the latest one left behind */
+};
+
+Pipeline *NewPipeline (int forwarding) {
+    Pipeline *p = calloc (1, sizeof(Pipeline));
+    int k;
+
+    if (p == NULL) {
+        return NULL;
+    }
+    p->forwarding = forwarding;
+    p->nextEx = 3;
+    for (k=0; k<32; k++) {
+        p->writerEx[k] = NEVER;
+    }
+    return p;
+}
+
+/* The FWD_ bits for a -c argument, or -1 if it isn't one. */
+int ParseForwarding (const char *name) {
+    if (strcmp (name, "none") == 0) {
+        return FWD_NONE;
+    } else if (strcmp (name, "exmem") == 0) {
+        return FWD_EXMEM;
+    } else if (strcmp (name, "memwb") == 0) {
+        return FWD_MEMWB;
+    } else if (strcmp (name, "full") == 0) {
+        return FWD_FULL;
+    }
+    return -1;
+}
+
+/* Whether register r can be read by an instruction in EX in cycle c */
+static int Readable (Pipeline *p, int r, long c) {
+    long e = p->writerEx[r];
+
+    if (r == 0 || c >= e + 3) {
+        return 1;
+    }
+    if (c == e + 1) {
+        return !p->writerLoad[r] && (p->forwarding & FWD_EXMEM);
+    }
+    return c == e + 2 && (p->forwarding & FWD_MEMWB);
+}
+
+/*
+ *  Account for d, at pc, having been executed, with nextPc the pc it
+ *  left behind.
+ */
+void PipeStep (Pipeline *p, DecodedInstr *d, unsigned int pc, unsigned int nextPc) {
+    int srcs[2], n, k, dest, load = 0;
+    long c = p->nextEx;
+
+    /* Only now is the flush behind the last instruction known to cost */
+    p->branchStalls += p->flushBranch;
+    p->jumpStalls += p->flushJump;
+    p->flushBranch = p->flushJump = 0;
+
+    n = SourceRegs (d, srcs);
+    for (k=0; k<n; k++) {
+        if (!Readable (p, srcs[k], c)) {
+            load |= p->writerLoad[srcs[k]];
+        }
+    }
+    while (1) {
+        for (k=0; k<n && Readable (p, srcs[k], c); k++)
+            ;
+        if (k == n) {
+            break;
+        }
+        c++;
+    }
+    if (load) {
+        p->loadUseStalls += c - p->nextEx;
+    } else {
+        p->dataStalls += c - p->nextEx;
+    }
+
+    dest = DestReg (d);
+    if (dest > 0) {
+        p->writerEx[dest] = c;
+        p->writerLoad[dest] = d->info->mem != M_NONE;
+    }
+
+    p->instructions++;
+    p->lastEx = c;
+    p->nextEx = c + 1;
+    if (d->info->next == PC_BRANCH) {
+        p->branches++;
+        if (nextPc != pc + 4) {
+            p->taken++;
+            p->flushBranch = 2;
+        }
+    } else if (d->info->next == PC_JUMP) {
+        p->flushJump = 1;
+    } else if (d->info->next == PC_JUMPREG) {
+        p->flushJump = 2;
+    }
+    p->nextEx += p->flushBranch + p->flushJump;
+}
+
+void PrintPipeline (Pipeline *p) {
+    long cycles = p->instructions ? p->lastEx + 2 : 0;
+
+    printf ("Pipeline: 5 stages, forwarding %s\n",
+            p->forwarding == FWD_FULL ? "EX/MEM and MEM/WB"
+            : p->forwarding == FWD_EXMEM ? "EX/MEM only"
+            : p->forwarding == FWD_MEMWB ? "MEM/WB only" : "none");
+    printf ("Cycles: %ld\n", cycles);
+    printf ("Instructions: %ld\n", p->instructions);
+    printf ("CPI: %.3f\n", p->instructions ? (double) cycles / p->instructions : 0.0);
+    printf ("Stall cycles: %ld\n", p->loadUseStalls + p->dataStalls
+                                   + p->branchStalls + p->jumpStalls);
+    printf ("  load-use      %ld\n", p->loadUseStalls);
+    printf ("  data hazard   %ld\n", p->dataStalls);
+    printf ("  branch flush  %ld (%ld of %ld branches taken)\n",
+            p->branchStalls, p->taken, p->branches);
+    printf ("  jump flush    %ld\n", p->jumpStalls);
+}
+
+void FreePipeline (Pipeline *p) {
+    free (p);
+}
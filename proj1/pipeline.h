@@ -0,0 +1,20 @@
+/*
+ *  Cycle-level timing of the classic 5-stage pipeline (IF, ID, EX, MEM,
+ *  WB), driven by the instructions the stages actually execute. It
+ *  doesn't change what the program does, only counts the cycles it
+ *  would take. Include computer.h first.
+ */
+
+/* Forwarding paths into EX; a bit set means the path exists */
+#define FWD_NONE 0
+#define FWD_EXMEM 1		/* EX/MEM latch -> EX: ALU result, next instr */
+#define FWD_MEMWB 2		/* MEM/WB latch -> EX: ALU or load, two later */
+#define FWD_FULL (FWD_EXMEM|FWD_MEMWB)
+
+typedef struct Pipeline Pipeline;
+
+Pipeline *NewPipeline (int forwarding);
+int ParseForwarding (const char *name);
+void PipeStep (Pipeline*, DecodedInstr*, unsigned int pc, unsigned int nextPc);
+void PrintPipeline (Pipeline*);
+void FreePipeline (Pipeline*);
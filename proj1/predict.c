@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "computer.h"
+#include "predict.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  The direction predictors all use 2-bit saturating counters, starting
+ *  weakly not taken, and predict taken from 2 up. Tables are indexed by
+ *  pc>>2; gshare XORs that with the outcomes of the last historyBits
+ *  conditional branches. The tournament predictor has its own bimodal
+ *  and gshare tables and a per-pc chooser counter, which moves toward
+ *  whichever of the two was right when they disagree.
+ *
+ *  Every taken branch, j, jal and jr other than jr $31 looks up its
+ *  target in the BTB; a miss or a stale target counts against it. jal
+ *  pushes its return address on the RAS and jr $31 pops it. The RAS
+ *  wraps around when it overflows, losing the oldest entries.
+ */
+
+enum { P_STATIC=0, P_BIMODAL, P_GSHARE, P_TOURNAMENT, NUMPREDICTORS };
+
+struct Predictors {
+    int historyBits;
+    unsigned int history;	/* last outcomes, newest in bit 0 */
+    unsigned char *bimodal;	/* 1 << BIMODAL_BITS counters */
+    unsigned char *gshare;	/* 1 << historyBits counters */
+    unsigned char *tBimodal, *tGshare, *chooser;	/* tournament's own */
+    unsigned int btbTag [BTB_ENTRIES];	/* pc of the entry, 0 if empty */
+    unsigned int btbTarget [BTB_ENTRIES];
+    unsigned int ras [RAS_ENTRIES];
+    int rasTop, rasCount;
+    long branches, taken;
+    long mispredicts [NUMPREDICTORS];
+    long btbLookups, btbMisses;
+    long returns, rasMisses;
+};
+
+static unsigned char *Counters (int bits) {
+    unsigned char *c = malloc (1 << bits);
+    int k;
+
+    if (c != NULL) {
+        for (k=0; k < 1<<bits; k++) {
+            c[k] = 1;
+        }
+    }
+    return c;
+}
+
+Predictors *NewPredictors (int historyBits) {
+    Predictors *p = calloc (1, sizeof(Predictors));
+
+    if (p == NULL) {
+        return NULL;
+    }
+    p->historyBits = historyBits;
+    p->bimodal = Counters (BIMODAL_BITS);
+    p->gshare = Counters (historyBits);
+    p->tBimodal = Counters (BIMODAL_BITS);
+    p->tGshare = Counters (historyBits);
+    p->chooser = Counters (BIMODAL_BITS);
+    if (p->bimodal == NULL || p->gshare == NULL || p->tBimodal == NULL
+        || p->tGshare == NULL || p->chooser == NULL) {
+        FreePredictors (p);
+        return NULL;
+    }
+    return p;
+}
+
+/* Move the counter at c toward taken or not. */
+static void Train (unsigned char *c, int taken) {
+    if (taken && *c < 3) {
+        (*c)++;
+    } else if (!taken && *c > 0) {
+        (*c)--;
+    }
+}
+
+/* Check the BTB's target for the taken transfer at pc, then update it. */
+static void LookupBTB (Predictors *p, unsigned int pc, unsigned int target) {
+    int k = (pc >> 2) % BTB_ENTRIES;
+
+    p->btbLookups++;
+    if (p->btbTag[k] != pc || p->btbTarget[k] != target) {
+        p->btbMisses++;
+    }
+    p->btbTag[k] = pc;
+    p->btbTarget[k] = target;
+}
+
+/* Remember a call's return address, pushing out the oldest if full */
+static void PushReturn (Predictors *p, unsigned int ra) {
+    p->rasTop = (p->rasTop + 1) % RAS_ENTRIES;
+    p->ras[p->rasTop] = ra;
+    if (p->rasCount < RAS_ENTRIES) {
+        p->rasCount++;
+    }
+}
+
+/*
+ *  Account for d, at pc, having been executed, with nextPc the pc it
+ *  left behind.
+ */
+void PredictStep (Predictors *p, DecodedInstr *d, unsigned int pc, unsigned int nextPc) {
+    unsigned int mask = (1 << p->historyBits) - 1;
+    unsigned int bi = (pc >> 2) & ((1 << BIMODAL_BITS) - 1);
+    unsigned int gi = ((pc >> 2) ^ p->history) & mask;
+    int taken, useG, bRight, gRight;
+
+    switch (d->info->next) {
+        case PC_BRANCH:
+            taken = nextPc != pc + 4;
+            p->branches++;
+            p->taken += taken;
+
+            p->mispredicts[P_STATIC] += taken;
+            p->mispredicts[P_BIMODAL] += (p->bimodal[bi] >= 2) != taken;
+            p->mispredicts[P_GSHARE] += (p->gshare[gi] >= 2) != taken;
+            Train (&p->bimodal[bi], taken);
+            Train (&p->gshare[gi], taken);
+
+            bRight = (p->tBimodal[bi] >= 2) == taken;
+            gRight = (p->tGshare[gi] >= 2) == taken;
+            useG = p->chooser[bi] >= 2;
+            p->mispredicts[P_TOURNAMENT] += !(useG ? gRight : bRight);
+            if (bRight != gRight) {
+                Train (&p->chooser[bi], gRight);
+            }
+            Train (&p->tBimodal[bi], taken);
+            Train (&p->tGshare[gi], taken);
+
+            p->history = ((p->history << 1) | taken) & mask;
+            if (taken) {
+                LookupBTB (p, pc, nextPc);
+                if (d->info->wb != W_NONE) {	/* bltzal, bgezal */
+                    PushReturn (p, pc + 4);
+                }
+            }
+            break;
+        case PC_JUMP:
+        case PC_JUMPREG:
+            if (d->info->wb != W_NONE) {	/* jal, jalr */
+                PushReturn (p, pc + 4);
+            }
+            if (d->info->next == PC_JUMP || d->info->wb != W_NONE
+                || d->regs.r.rs != 31) {
+                LookupBTB (p, pc, nextPc);
+                break;
+            }
+            /* jr $ra */
+            p->returns++;
+            if (p->rasCount == 0 || p->ras[p->rasTop] != nextPc) {
+                p->rasMisses++;
+            }
+            if (p->rasCount > 0) {
+                p->rasTop = (p->rasTop + RAS_ENTRIES - 1) % RAS_ENTRIES;
+                p->rasCount--;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* Percentage of n that ok is, or 100 if n is 0 */
+static double Percent (long ok, long n) {
+    return n ? 100.0 * ok / n : 100.0;
+}
+
+void PrintPredictors (Predictors *p, long instructions) {
+    static const char *names[NUMPREDICTORS] = {
+        "static not-taken", "bimodal", "gshare", "tournament"
+    };
+    double kilo = instructions ? instructions / 1000.0 : 1.0;
+    int k;
+
+    printf ("Branch prediction: %ld conditional branches, %ld taken\n",
+            p->branches, p->taken);
+    printf ("PREDICTOR         MISPREDICTS  ACCURACY      MPKI\n");
+    for (k=0; k<NUMPREDICTORS; k++) {
+        printf ("%-16s  %11ld  %7.2f%%  %8.3f\n", names[k], p->mispredicts[k],
+                Percent (p->branches - p->mispredicts[k], p->branches),
+                p->mispredicts[k] / kilo);
+    }
+    printf ("  (bimodal %d entries, gshare %d bits of history)\n",
+            1 << BIMODAL_BITS, p->historyBits);
+    printf ("BTB (%d entries): %ld lookups, %ld misses, %.2f%% hit, %.3f MPKI\n",
+            BTB_ENTRIES, p->btbLookups, p->btbMisses,
+            Percent (p->btbLookups - p->btbMisses, p->btbLookups),
+            p->btbMisses / kilo);
+    printf ("RAS (%d entries): %ld returns, %ld misses, %.2f%% hit, %.3f MPKI\n",
+            RAS_ENTRIES, p->returns, p->rasMisses,
+            Percent (p->returns - p->rasMisses, p->returns),
+            p->rasMisses / kilo);
+}
+
+void FreePredictors (Predictors *p) {
+    free (p->bimodal);
+    free (p->gshare);
+    free (p->tBimodal);
+    free (p->tGshare);
+    free (p->chooser);
+    free (p);
+}
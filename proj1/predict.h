@@ -0,0 +1,18 @@
+/*
+ *  Branch predictors simulated side by side on the control flow the
+ *  stages actually execute: static not-taken, 2-bit bimodal, gshare and
+ *  a tournament of the last two for the direction of beq/bne, and a BTB
+ *  and return-address stack for targets. None of them change what the
+ *  program does. Include computer.h first.
+ */
+
+#define BIMODAL_BITS 12		/* log2 of bimodal and chooser table sizes */
+#define BTB_ENTRIES 512		/* direct mapped */
+#define RAS_ENTRIES 16
+
+typedef struct Predictors Predictors;
+
+Predictors *NewPredictors (int historyBits);
+void PredictStep (Predictors*, DecodedInstr*, unsigned int pc, unsigned int nextPc);
+void PrintPredictors (Predictors*, long instructions);
+void FreePredictors (Predictors*);
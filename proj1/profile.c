@@ -0,0 +1,263 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "computer.h"
+#include "profile.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  All the per-pc counters are flat arrays indexed by the word's offset
+ *  in the text region, (pc - 0x00400000)/4. ProfileStep() only counts
+ *  each word's executions and which way each branch went, and notes
+ *  where the next block starts; the rest is worked out by
+ *  PrintProfile(). The opcode and funct totals come from the count of
+ *  each word and what is decoded there. Only what is run from outside
+ *  the text region is counted op by op, toward those totals and
+ *  "outside".
+ *
+ *  A block starts with the first instruction run and with whatever
+ *  follows a beq, bne, j, jal or jr, whichever way it went; its
+ *  instructions are credited to the pc it started at. Blocks are
+ *  straight-line code, so every run of a word that isn't a control
+ *  instruction is followed by a run of the next word, except perhaps
+ *  the last one; the runs of a word that don't follow on like that are
+ *  the blocks that start there. Every block but the last then goes all
+ *  the way to the next control instruction, and the last stops short
+ *  at the pc the computer has got to.
+ */
+
+struct Profile {
+    unsigned int textBase;
+    int textWords;
+    long *counts;		/* executions of each text word */
+    long *taken;		/* times the branch at each word was taken */
+    long ops [64];		/* executions of each opcode outside text */
+    long functs [64];		/* and of each funct, for opcode 0 */
+    long outside;
+    unsigned int block;		/* pc the latest block started at */
+};
+
+typedef struct {
+    long count;
+    int word;
+} Ranked;
+
+Profile *NewProfile (Computer* mips) {
+    Profile *p = calloc (1, sizeof(Profile));
+    int n = mips->textWords;
+
+    if (p == NULL) {
+        return NULL;
+    }
+    p->textBase = mips->regions[SEG_TEXT].base;
+    p->textWords = n;
+    p->counts = calloc (n, sizeof(long));
+    p->taken = calloc (n, sizeof(long));
+    if (p->counts == NULL || p->taken == NULL) {
+        FreeProfile (p);
+        return NULL;
+    }
+    p->block = mips->pc;
+    return p;
+}
+
+/*
+ *  Count d, at pc, having been executed, with nextPc the pc it left
+ *  behind.
+ */
+void ProfileStep (Profile *p, DecodedInstr *d, unsigned int pc, unsigned int nextPc) {
+    unsigned int k = (pc - p->textBase) >> 2;
+
+    if (k >= p->textWords) {
+        p->outside++;
+        p->ops[d->op]++;
+        if (d->op == 0) {
+            p->functs[d->regs.r.funct]++;
+        }
+        p->block = nextPc;
+        return;
+    }
+    p->counts[k]++;
+    if (d->info->next != PC_NEXT) {
+        if (d->info->next == PC_BRANCH && nextPc != pc + 4) {
+            p->taken[k]++;
+        }
+        p->block = nextPc;
+    }
+}
+
+/* Higher count first, then lower pc */
+static int CompareRanked (const void *a, const void *b) {
+    const Ranked *x = a, *y = b;
+
+    if (x->count != y->count) {
+        return x->count < y->count ? 1 : -1;
+    }
+    return x->word - y->word;
+}
+
+/*
+ *  Put the words whose count is nonzero in order, highest first, and
+ *  return how many there are.
+ */
+static int Rank (Profile *p, long *counts, Ranked *order) {
+    int k, n = 0;
+
+    for (k=0; k<p->textWords; k++) {
+        if (counts[k] != 0) {
+            order[n].count = counts[k];
+            order[n].word = k;
+            n++;
+        }
+    }
+    qsort (order, n, sizeof(Ranked), CompareRanked);
+    return n;
+}
+
+static double Share (long n, long total) {
+    return total ? 100.0 * n / total : 0.0;
+}
+
+/* The name of the instruction instr, or unknown if it isn't one */
+static const char *MixName (Computer* mips, unsigned int instr, const char *unknown) {
+    const InstrInfo *info = LookupInstr (instr, mips->fullIsa);
+
+    return info != NULL && info->name != NULL ? info->name : unknown;
+}
+
+static int IsControl (DecodedInstr *d) {
+    return d->info != NULL && d->info->next != PC_NEXT;
+}
+
+/*
+ *  Work out how many blocks started at each word, and how many
+ *  instructions they ran between them.
+ */
+static void CountBlocks (Profile *p, Computer* mips, long *entries, long *blockInstrs) {
+    unsigned int pc = mips->pc, last = (p->block - p->textBase) >> 2;
+    long partial = 0;		/* words the last block ran, if it stopped short */
+    long run = 0;		/* words from here to the next control instruction */
+    int k;
+
+    if (last < p->textWords && pc > p->block && (pc - p->block) % 4 == 0) {
+        partial = (pc - p->block) >> 2;
+        for (k=last; k<last+partial; k++) {
+            if (k >= p->textWords || IsControl (&mips->decoded[k])) {
+                partial = 0;
+                break;
+            }
+        }
+    }
+    for (k=p->textWords-1; k>=0; k--) {
+        run = IsControl (&mips->decoded[k]) ? 1 : run + 1;
+        entries[k] = p->counts[k];
+        if (k > 0 && !IsControl (&mips->decoded[k-1])) {
+            /* less the runs that followed on from the word before */
+            entries[k] -= p->counts[k-1];
+            if (partial > 0 && k == last + partial) {
+                entries[k]++;
+            }
+        }
+        blockInstrs[k] = entries[k] * run;
+        if (partial > 0 && k == last && partial < run) {
+            blockInstrs[k] -= run - partial;
+        }
+    }
+}
+
+void PrintProfile (Profile *p, Computer* mips) {
+    Ranked *order = malloc ((p->textWords > 0 ? p->textWords : 1) * sizeof(Ranked));
+    long *outcomes = malloc ((p->textWords > 0 ? p->textWords : 1) * sizeof(long));
+    long *entries = malloc ((p->textWords > 0 ? p->textWords : 1) * sizeof(long));
+    long *blockInstrs = malloc ((p->textWords > 0 ? p->textWords : 1) * sizeof(long));
+    long ops [64], functs [64], total = p->outside;
+    DecodedInstr *d;
+    char buf[40];
+    int n, k, w;
+
+    if (order == NULL || outcomes == NULL || entries == NULL || blockInstrs == NULL) {
+        free (order);
+        free (outcomes);
+        free (entries);
+        free (blockInstrs);
+        fprintf (stderr, "Out of memory.\n");
+        return;
+    }
+    CountBlocks (p, mips, entries, blockInstrs);
+    for (k=0; k<64; k++) {
+        ops[k] = p->ops[k];
+        functs[k] = p->functs[k];
+    }
+    for (k=0; k<p->textWords; k++) {
+        d = &mips->decoded[k];
+        outcomes[k] = 0;
+        if (p->counts[k] == 0) {
+            continue;
+        }
+        total += p->counts[k];
+        ops[d->op] += p->counts[k];
+        if (d->op == 0) {
+            functs[d->regs.r.funct] += p->counts[k];
+        }
+        if (d->info != NULL && d->info->next == PC_BRANCH) {
+            outcomes[k] = p->counts[k];
+        }
+    }
+    printf ("Profile: %ld instructions, %ld outside the text segment\n",
+            total, p->outside);
+
+    printf ("Hot spots\n");
+    printf ("COUNT            %%  PC        INSTRUCTION\n");
+    n = Rank (p, p->counts, order);
+    for (k=0; k<n && k<PROFILE_TOP; k++) {
+        w = order[k].word;
+        Disassemble (&mips->decoded[w], buf, sizeof(buf));
+        printf ("%-12ld %6.2f  %8.8x  %s\n", p->counts[w],
+                Share (p->counts[w], total), p->textBase + 4*w, buf);
+    }
+
+    printf ("Hot blocks\n");
+    printf ("INSTRUCTIONS     %%  ENTRIES      START     AVG LEN\n");
+    n = Rank (p, blockInstrs, order);
+    for (k=0; k<n && k<PROFILE_TOP; k++) {
+        w = order[k].word;
+        printf ("%-12ld %6.2f  %-12ld %8.8x  %.1f\n", blockInstrs[w],
+                Share (blockInstrs[w], total), entries[w],
+                p->textBase + 4*w, (double) blockInstrs[w] / entries[w]);
+    }
+
+    printf ("Branches\n");
+    printf ("TAKEN        NOT TAKEN    %%TAKEN  PC        INSTRUCTION\n");
+    n = Rank (p, outcomes, order);
+    for (k=0; k<n && k<PROFILE_TOP; k++) {
+        w = order[k].word;
+        Disassemble (&mips->decoded[w], buf, sizeof(buf));
+        printf ("%-12ld %-12ld %6.2f  %8.8x  %s\n", p->taken[w],
+                outcomes[w] - p->taken[w], Share (p->taken[w], outcomes[w]),
+                p->textBase + 4*w, buf);
+    }
+
+    printf ("Instruction mix\n");
+    printf ("COUNT            %%  INSTRUCTION\n");
+    for (k=0; k<64; k++) {
+        if (k != 0 && ops[k] != 0) {
+            printf ("%-12ld %6.2f  %s\n", ops[k], Share (ops[k], total),
+                    k == 1 ? "bltz/bgez" : MixName (mips, k << 26, "?"));
+        }
+    }
+    for (k=0; k<64; k++) {
+        if (functs[k] != 0) {
+            printf ("%-12ld %6.2f  %s\n", functs[k], Share (functs[k], total),
+                    MixName (mips, k, "(nop)"));
+        }
+    }
+    free (order);
+    free (outcomes);
+    free (entries);
+    free (blockInstrs);
+}
+
+void FreeProfile (Profile *p) {
+    free (p->counts);
+    free (p->taken);
+    free (p);
+}
@@ -0,0 +1,14 @@
+/*
+ *  Execution profile of a run: how often each text word, opcode/funct
+ *  and basic block ran, and which way each branch went, with a hot-spot
+ *  report at the end. Include computer.h first.
+ */
+
+#define PROFILE_TOP 20		/* lines in each part of the report */
+
+typedef struct Profile Profile;
+
+Profile *NewProfile (Computer*);
+void ProfileStep (Profile*, DecodedInstr*, unsigned int pc, unsigned int nextPc);
+void PrintProfile (Profile*, Computer*);
+void FreeProfile (Profile*);
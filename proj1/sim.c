@@ -1,16 +1,60 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include "computer.h"
+#include "trace.h"
+#include "pipeline.h"
+#include "ooo.h"
+#include "ilp.h"
+#include "loop.h"
+#include "predict.h"
+#include "profile.h"
+#include "statehash.h"
+#include "undo.h"
 
 #define TRUE 1
 #define FALSE 0
 
+static Computer mips;
+
 int main (int argc, char *argv[]) {
     int argIndex;
     int printingRegisters = FALSE;
     int printingMemory = FALSE;
     int debugging = FALSE;
     int interactive = FALSE;
+    Engine engine = STAGED;
+    int quiet = FALSE;
+    int fullIsa = FALSE;
+    Layout layout = LAYOUT_COURSE;
+    int forwarding = -1;		/* no pipeline model */
+    Pipeline *pipeline = NULL;
+    int outOfOrder = FALSE;
+    OooConfig oooConfig;
+    Ooo *ooo = NULL;
+    int dataflow = FALSE;
+    Ilp *ilp = NULL;
+    int historyBits = 0;		/* no branch predictors */
+    Predictors *predictors = NULL;
+    int profiling = FALSE;
+    Profile *profile = NULL;
+    char *tracePath = NULL;
+    TraceWriter *trace = NULL;
+    long checkpointAt = 0;		/* no checkpoint */
+    char *resumePath = NULL;
+    char checkpointPath[1024];
+    char *emitPath = NULL;
+    char *hashPath = NULL;		/* no state hash */
+    long hashEvery = 1000000, hashFrom = 0, hashTo = LONG_MAX;
+    StateHash *hashes = NULL;
+    FILE *hashLog = NULL;
+    UndoLog *undo = NULL;
+    long maxInsns = LONG_MAX;
+    int loopCheck = TRUE;
+    LoopCheck *loops = NULL;
+    HaltReason halted;
+    FILE *out;
     FILE *filein;
 
     if (argc < 2) {
@@ -18,7 +62,75 @@ int main (int argc, char *argv[]) {
         exit (1);
     }
     for (argIndex=1; argIndex<argc && argv[argIndex][0]=='-'; argIndex++) {
-        /* Argument is an option, we hope one of -r, -m, -i, -d. */
+        if (strcmp (argv[argIndex], "--checkpoint-at") == 0) {
+            /* save the state after N instructions in <file>.ckpt */
+            if (argIndex+1 >= argc || (checkpointAt = atol (argv[++argIndex])) < 1) {
+                fprintf (stderr, "--checkpoint-at needs an instruction count.\n");
+                exit (1);
+            }
+            continue;
+        } else if (strcmp (argv[argIndex], "--max-insns") == 0) {
+            /* stop with "Instruction limit reached" after N instructions */
+            if (argIndex+1 >= argc || (maxInsns = atol (argv[++argIndex])) < 1) {
+                fprintf (stderr, "--max-insns needs an instruction count.\n");
+                exit (1);
+            }
+            continue;
+        } else if (strcmp (argv[argIndex], "--no-loop-check") == 0) {
+            /* let a stuck program run on; see loop.h */
+            loopCheck = FALSE;
+            continue;
+        } else if (strcmp (argv[argIndex], "--ilp") == 0) {
+            /* the run's dataflow limit, and the chains behind it */
+            dataflow = TRUE;
+            continue;
+        } else if (strcmp (argv[argIndex], "--resume") == 0) {
+            /* start from a checkpoint instead of a dump file */
+            if (argIndex+1 >= argc) {
+                fprintf (stderr, "--resume needs a checkpoint file name.\n");
+                exit (1);
+            }
+            resumePath = argv[++argIndex];
+            continue;
+        } else if (strcmp (argv[argIndex], "--emit-c") == 0) {
+            /* translate the program to C instead of running it */
+            if (argIndex+1 >= argc) {
+                fprintf (stderr, "--emit-c needs an output file name.\n");
+                exit (1);
+            }
+            emitPath = argv[++argIndex];
+            continue;
+        } else if (strcmp (argv[argIndex], "--hash-log") == 0) {
+            /* log the state hash every so often, for simhash */
+            if (argIndex+1 >= argc) {
+                fprintf (stderr, "--hash-log needs a log file name.\n");
+                exit (1);
+            }
+            hashPath = argv[++argIndex];
+            continue;
+        } else if (strcmp (argv[argIndex], "--hash-every") == 0) {
+            /* a line in the hash log every n instructions */
+            if (argIndex+1 >= argc || (hashEvery = atol (argv[++argIndex])) < 1) {
+                fprintf (stderr, "--hash-every needs an instruction count.\n");
+                exit (1);
+            }
+            continue;
+        } else if (strcmp (argv[argIndex], "--hash-from") == 0) {
+            /* but only from instruction n on */
+            if (argIndex+1 >= argc || (hashFrom = atol (argv[++argIndex])) < 0) {
+                fprintf (stderr, "--hash-from needs an instruction count.\n");
+                exit (1);
+            }
+            continue;
+        } else if (strcmp (argv[argIndex], "--hash-to") == 0) {
+            /* and up to instruction n */
+            if (argIndex+1 >= argc || (hashTo = atol (argv[++argIndex])) < 0) {
+                fprintf (stderr, "--hash-to needs an instruction count.\n");
+                exit (1);
+            }
+            continue;
+        }
+        /* Argument is an option, we hope one of -r, -m, -i, -d, -f, -j, -q, -s, -x, -t, -c, -o, -b, -p. */
         switch (argv[argIndex][1]) {
             case 'r':
             printingRegisters = TRUE;
@@ -32,28 +144,283 @@ int main (int argc, char *argv[]) {
             case 'd':
             debugging = TRUE;
             break;
+            case 'f':
+            engine = THREADED;
+            break;
+            case 'j':
+            engine = JIT;
+            break;
+            case 'q':
+            quiet = TRUE;
+            break;
+            case 's':
+            layout = LAYOUT_SPIM;
+            break;
+            case 'x':
+            /* all of the MIPS-I integer instructions, not just the course's */
+            fullIsa = TRUE;
+            break;
+            case 't':
+            /* -t <file>: quiet, with a binary trace for simtrace */
+            if (argIndex+1 >= argc) {
+                fprintf (stderr, "-t needs a trace file name.\n");
+                exit (1);
+            }
+            tracePath = argv[++argIndex];
+            quiet = TRUE;
+            break;
+            case 'c':
+            /* -c <forwarding>: time the run on the 5-stage pipeline */
+            if (argIndex+1 >= argc
+                || (forwarding = ParseForwarding (argv[++argIndex])) < 0) {
+                fprintf (stderr, "-c needs one of none, exmem, memwb, full.\n");
+                exit (1);
+            }
+            break;
+            case 'o':
+            /* -o <config>: time the run on an out-of-order core, see ParseOoo() */
+            if (argIndex+1 >= argc || ParseOoo (argv[++argIndex], &oooConfig) < 0) {
+                fprintf (stderr, "-o needs \"default\" or settings like width=4,rob=128,rs=48,\n");
+                fprintf (stderr, "alus=4,ports=2,load=3,mul=4,div=20.\n");
+                exit (1);
+            }
+            outOfOrder = TRUE;
+            break;
+            case 'p':
+            profiling = TRUE;
+            break;
+            case 'b':
+            /* -b <bits>: branch predictors, gshare keeping <bits> of history */
+            if (argIndex+1 >= argc || (historyBits = atoi (argv[++argIndex])) < 1
+                || historyBits > 24) {
+                fprintf (stderr, "-b needs a history length from 1 to 24.\n");
+                exit (1);
+            }
+            break;
             default:
             fprintf (stderr, "Invalid option \"%s\".\n", argv[argIndex]);
-            fprintf (stderr, "Correct options are -r, -m, -i, -d.\n");
+            fprintf (stderr, "Correct options are -r, -m, -i, -d, -f, -j, -q, -s, -x, -t <file>, -c <forwarding>,\n");
+            fprintf (stderr, "-o <config>, -b <bits>, -p, --checkpoint-at <n>, --resume <file>, --emit-c <file>,\n");
+            fprintf (stderr, "--hash-log <file>, --hash-every <n>, --hash-from <n>, --hash-to <n>, --ilp,\n");
+            fprintf (stderr, "--max-insns <n>, --no-loop-check.\n");
+            fprintf (stderr, "Unless --no-loop-check is given, a staged run stops once it is stuck in a loop;\n");
+            fprintf (stderr, "-f, -j, --emit-c and the lanes of simfork -q -v only catch a branch to itself,\n");
+            fprintf (stderr, "so a longer loop there runs until the instruction limit.\n");
             exit (1);
         }
     }
-    if (argIndex == argc) {
+    if (argIndex == argc && resumePath == NULL) {
         fprintf (stderr, "No file name given.\n");
         exit (1);
-    } else if (argIndex < argc-1) {
+    } else if (argIndex < argc-1 || (argIndex < argc && resumePath != NULL)) {
         fprintf (stderr, "Too many arguments.\n");
         exit (1);
     }
     
-    filein = fopen (argv[argIndex], "r");
-    if (filein == NULL) {
-        fprintf (stderr, "Can't open file: %s\n", argv[argIndex]);
+    if (tracePath != NULL && engine != STAGED) {
+        fprintf (stderr, "-t can't be used with -f or -j.\n");
         exit (1);
     }
-    
-    InitComputer (filein, printingRegisters, printingMemory,
-	debugging, interactive);
-    Simulate ();
+    if ((forwarding >= 0 || outOfOrder || historyBits > 0 || profiling || dataflow)
+        && engine != STAGED) {
+        fprintf (stderr, "-c, -o, -b, -p and --ilp can't be used with -f or -j.\n");
+        exit (1);
+    }
+    if (hashPath != NULL && (engine != STAGED || resumePath != NULL || interactive)) {
+        /* the hash covers every instruction from the start, once */
+        fprintf (stderr, "--hash-log can't be used with -f, -j, -i or --resume.\n");
+        exit (1);
+    }
+    if (tracePath != NULL && (checkpointAt > 0 || resumePath != NULL)) {
+        fprintf (stderr, "-t can't be used with --checkpoint-at or --resume.\n");
+        exit (1);
+    }
+
+    if (resumePath != NULL) {
+        if (LoadCheckpoint (&mips, resumePath) < 0) {
+            fprintf (stderr, "Can't load checkpoint: %s\n", resumePath);
+            exit (1);
+        }
+        mips.printingRegisters = printingRegisters;
+        mips.printingMemory = printingMemory;
+        mips.interactive = interactive;
+        mips.debugging = debugging;
+    } else {
+        filein = fopen (argv[argIndex], "r");
+        if (filein == NULL) {
+            fprintf (stderr, "Can't open file: %s\n", argv[argIndex]);
+            exit (1);
+        }
+        if (InitComputer (&mips, filein, layout, printingRegisters, printingMemory,
+            debugging, interactive) < 0) {
+            fprintf (stderr, "Program too big.\n");
+            exit (1);
+        }
+        fclose (filein);
+    }
+
+    /* A checkpoint remembers which instruction set it was running */
+    if (fullIsa || mips.fullIsa) {
+        if (engine != STAGED || tracePath != NULL || emitPath != NULL) {
+            fprintf (stderr, "-x can't be used with -f, -j, -t or --emit-c.\n");
+            exit (1);
+        }
+        SetFullIsa (&mips, TRUE);
+    }
+
+    mips.selfLoops = loopCheck;
+    if (emitPath != NULL) {
+        out = fopen (emitPath, "w");
+        if (out == NULL || EmitC (&mips, out) < 0 || fclose (out) != 0) {
+            fprintf (stderr, "Can't write C file: %s\n", emitPath);
+            exit (1);
+        }
+        FreeComputer (&mips);
+        return 0;
+    }
+
+    if (tracePath != NULL) {
+        trace = OpenTrace (tracePath, mips.registers[29], layout);
+        if (trace == NULL) {
+            fprintf (stderr, "Can't create trace file: %s\n", tracePath);
+            exit (1);
+        }
+    }
+    mips.engine = engine;
+    mips.quiet = quiet;
+    mips.trace = trace;
+    if (hashPath != NULL) {
+        hashLog = fopen (hashPath, "w");
+        if (hashLog == NULL) {
+            fprintf (stderr, "Can't create hash log: %s\n", hashPath);
+            exit (1);
+        }
+        hashes = mips.hashes = NewStateHash (hashLog, hashEvery, hashFrom, hashTo);
+        if (hashes == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+
+    /*
+     * Run up to the checkpoint without printing anything, then carry on
+     * exactly as --resume from that checkpoint would.
+     */
+    if (checkpointAt > 0) {
+        snprintf (checkpointPath, sizeof(checkpointPath), "%s.ckpt",
+                  resumePath != NULL ? resumePath : argv[argIndex]);
+        if (StepN (&mips, checkpointAt - mips.instrCount) > 0
+            && mips.halted == RUNNING) {
+            if (SaveCheckpoint (&mips, checkpointPath) < 0) {
+                fprintf (stderr, "Can't write checkpoint: %s\n", checkpointPath);
+                exit (1);
+            }
+        } else {
+            fprintf (stderr, "Program stopped before %ld instructions; no checkpoint.\n",
+                     checkpointAt);
+        }
+    }
+    if (forwarding >= 0) {
+        pipeline = mips.pipeline = NewPipeline (forwarding);
+        if (pipeline == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    if (outOfOrder) {
+        ooo = mips.ooo = NewOoo (&oooConfig);
+        if (ooo == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    if (dataflow) {
+        ilp = mips.ilp = NewIlp (&mips);
+        if (ilp == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    if (historyBits > 0) {
+        predictors = mips.predictors = NewPredictors (historyBits);
+        if (predictors == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    if (profiling) {
+        profile = mips.profile = NewProfile (&mips);
+        if (profile == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    if (loopCheck && engine == STAGED) {
+        /* the other engines don't say what each instruction changed, so
+           they only catch branches to themselves */
+        loops = mips.loops = NewLoopCheck (&mips);
+        if (loops == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    mips.maxInsns = maxInsns;
+    if (interactive) {
+        /* so rs and rc can go back */
+        undo = mips.undo = NewUndoLog (&mips);
+        if (undo == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    Simulate (&mips);
+    if (undo != NULL) {
+        FreeUndoLog (undo);
+    }
+    if (pipeline != NULL) {
+        PrintPipeline (pipeline);
+        FreePipeline (pipeline);
+    }
+    if (ooo != NULL) {
+        PrintOoo (ooo);
+        FreeOoo (ooo);
+    }
+    if (loops != NULL) {
+        PrintLoopCheck (loops);
+        FreeLoopCheck (loops);
+    }
+    if (ilp != NULL) {
+        PrintIlp (ilp, &mips);
+        FreeIlp (ilp);
+    }
+    if (predictors != NULL) {
+        PrintPredictors (predictors, mips.instrCount);
+        FreePredictors (predictors);
+    }
+    if (profile != NULL) {
+        PrintProfile (profile, &mips);
+        FreeProfile (profile);
+    }
+    if (hashes != NULL) {
+        FinishStateHash (hashes, &mips);
+        FreeStateHash (hashes);
+        if (fclose (hashLog) != 0) {
+            fprintf (stderr, "Error writing hash log: %s\n", hashPath);
+            exit (1);
+        }
+    }
+    halted = mips.halted;
+    FreeComputer (&mips);
+    if (trace != NULL && CloseTrace (trace) != 0) {
+        fprintf (stderr, "Error writing trace file: %s\n", tracePath);
+        exit (1);
+    }
+
+    /* So a batch of runs can tell these apart from a program's own end */
+    if (halted == HALT_LIMIT) {
+        return 2;
+    } else if (halted == HALT_LOOP) {
+        return 3;
+    }
     return 0;
 }
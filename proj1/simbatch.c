@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <limits.h>
+#include <pthread.h>
+#include "computer.h"
+#include "loop.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Run every .dump file in a directory, each on its own Computer,
+ *  spread over a pool of threads. Each program runs quietly until it
+ *  stops, is found to be stuck in a loop (see loop.h) or hits the
+ *  instruction limit, 100 million unless -n says otherwise, so one bad
+ *  program can't hold up the batch. It gets one line in the report: why
+ *  it stopped, how many instructions it ran, its final pc, and $v0.
+ *  The lines come out in file name order, however the threads finish.
+ */
+
+typedef struct {
+    char *name;			/* file name within the directory */
+    int tooBig;			/* InitComputer refused it */
+    int missing;		/* couldn't open it */
+    HaltReason halted;
+    long instrCount;
+    int pc;
+    int v0;
+} Job;
+
+static char *dirName;
+static Job *jobs;
+static int numJobs;
+static int nextJob = 0;		/* first job no thread has taken */
+static pthread_mutex_t jobLock = PTHREAD_MUTEX_INITIALIZER;
+static Engine engine = THREADED;
+static long maxInsns = 100000000;
+static Layout layout = LAYOUT_COURSE;
+
+static int CompareJobs (const void *a, const void *b) {
+    return strcmp (((Job *) a)->name, ((Job *) b)->name);
+}
+
+static void RunJob (Computer* mips, Job *job) {
+    char path[PATH_MAX];
+    FILE *filein;
+
+    snprintf (path, sizeof(path), "%s/%s", dirName, job->name);
+    filein = fopen (path, "r");
+    if (filein == NULL) {
+        job->missing = 1;
+        return;
+    }
+    if (InitComputer (mips, filein, layout, 0, 0, 0, 0) < 0) {
+        job->tooBig = 1;
+        fclose (filein);
+        return;
+    }
+    fclose (filein);
+    mips->engine = engine;
+    if (engine == STAGED) {
+        /* the others catch only branches to themselves */
+        mips->loops = NewLoopCheck (mips);
+        if (mips->loops == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    StepN (mips, maxInsns);
+    if (mips->loops != NULL) {
+        FreeLoopCheck (mips->loops);
+    }
+    job->halted = mips->halted;
+    job->instrCount = mips->instrCount;
+    job->pc = mips->pc;
+    job->v0 = mips->registers[2];
+    FreeComputer (mips);
+}
+
+/* Take jobs until there are none left. */
+static void *Worker (void *arg) {
+    Computer *mips = malloc (sizeof(Computer));
+    int k;
+
+    if (mips == NULL) {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+    }
+    while (1) {
+        pthread_mutex_lock (&jobLock);
+        k = nextJob++;
+        pthread_mutex_unlock (&jobLock);
+        if (k >= numJobs) {
+            break;
+        }
+        RunJob (mips, &jobs[k]);
+    }
+    free (mips);
+    return NULL;
+}
+
+int main (int argc, char *argv[]) {
+    int argIndex, k, numThreads = 4, len;
+    pthread_t *threads;
+    DIR *dir;
+    struct dirent *entry;
+    long total = 0;
+
+    for (argIndex=1; argIndex<argc && argv[argIndex][0]=='-'; argIndex++) {
+        switch (argv[argIndex][1]) {
+            case 'p':
+            if (argIndex+1 >= argc || (numThreads = atoi (argv[++argIndex])) < 1) {
+                fprintf (stderr, "-p needs a thread count.\n");
+                exit (1);
+            }
+            break;
+            case 'n':
+            if (argIndex+1 >= argc || (maxInsns = atol (argv[++argIndex])) < 1) {
+                fprintf (stderr, "-n needs an instruction limit.\n");
+                exit (1);
+            }
+            break;
+            case 'q':
+            engine = STAGED;
+            break;
+            case 'j':
+            engine = JIT;
+            break;
+            case 's':
+            layout = LAYOUT_SPIM;
+            break;
+            default:
+            fprintf (stderr, "Invalid option \"%s\".\n", argv[argIndex]);
+            fprintf (stderr, "Correct options are -p <threads>, -n <insns>, -q, -j, -s.\n");
+            exit (1);
+        }
+    }
+    if (argIndex != argc-1) {
+        fprintf (stderr, "Usage: simbatch [-p threads] [-n insns] [-q|-j] [-s] directory\n");
+        exit (1);
+    }
+    dirName = argv[argIndex];
+
+    dir = opendir (dirName);
+    if (dir == NULL) {
+        fprintf (stderr, "Can't open directory: %s\n", dirName);
+        exit (1);
+    }
+    numJobs = 0;
+    jobs = NULL;
+    while ((entry = readdir (dir)) != NULL) {
+        len = strlen (entry->d_name);
+        if (len <= 5 || strcmp (entry->d_name + len - 5, ".dump") != 0) {
+            continue;
+        }
+        jobs = realloc (jobs, (numJobs+1) * sizeof(Job));
+        if (jobs == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+        memset (&jobs[numJobs], 0, sizeof(Job));
+        jobs[numJobs].name = strdup (entry->d_name);
+        numJobs++;
+    }
+    closedir (dir);
+    if (numJobs > 0) {
+        qsort (jobs, numJobs, sizeof(Job), CompareJobs);
+    }
+
+    if (numThreads > numJobs) {
+        numThreads = numJobs > 0 ? numJobs : 1;
+    }
+    threads = malloc (numThreads * sizeof(pthread_t));
+    for (k=0; k<numThreads; k++) {
+        if (pthread_create (&threads[k], NULL, Worker, NULL) != 0) {
+            fprintf (stderr, "Can't start thread.\n");
+            exit (1);
+        }
+    }
+    for (k=0; k<numThreads; k++) {
+        pthread_join (threads[k], NULL);
+    }
+
+    for (k=0; k<numJobs; k++) {
+        if (jobs[k].missing) {
+            printf ("%s: can't open file\n", jobs[k].name);
+        } else if (jobs[k].tooBig) {
+            printf ("%s: program too big\n", jobs[k].name);
+        } else {
+            printf ("%s: %s, %ld instructions, pc = %8.8x, $v0 = %8.8x\n",
+                    jobs[k].name,
+                    jobs[k].halted == RUNNING ? "instruction limit"
+                                              : HaltName (jobs[k].halted),
+                    jobs[k].instrCount, jobs[k].pc, jobs[k].v0);
+            total += jobs[k].instrCount;
+        }
+        free (jobs[k].name);
+    }
+    printf ("%d programs, %ld instructions\n", numJobs, total);
+    free (jobs);
+    free (threads);
+    return 0;
+}
@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "computer.h"
+#include "lanes.h"
+#include "loop.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Run one program over many sets of arguments. The dump file is read,
+ *  loaded and predecoded once; then for each line of a CSV file of up
+ *  to four integers a child is forked with those in $a0-$a3 and runs
+ *  quietly until it stops, is found to be stuck in a loop (see loop.h)
+ *  or hits the instruction limit, 100 million unless -n says otherwise.
+ *  The child's memory is a copy-on-write copy of the parent's, so
+ *  starting a run costs a fork and the pages that run writes. Children
+ *  put their results in a shared mapping; each line of input gets one
+ *  line in the report, in input order: why the run stopped, how many
+ *  instructions it ran, its final pc, and $v0.
+ *
+ *  With -v each child instead takes LANES lines at a time, makes that
+ *  many copies of the loaded computer and runs them in lockstep with
+ *  RunLanes(); the children share the lines out between them. The lanes
+ *  only catch a branch to itself, not the full loop check, so a lane
+ *  stuck in a longer loop runs until the instruction limit.
+ */
+
+typedef struct {
+    int args [4];		/* $a0-$a3 */
+    int done;			/* the child filled in the rest */
+    HaltReason halted;
+    long instrCount;
+    int pc;
+    int v0;
+} Run;
+
+/*
+ *  Read the argument lines of the CSV file. Blank lines and lines
+ *  starting with # are skipped; missing arguments are 0. Returns the
+ *  number of runs, with the array in *runs.
+ */
+static int ReadInputs (FILE *in, Run **runs) {
+    char line[1024], *s, *end;
+    int n = 0, max = 0, lineNum = 0, k;
+
+    *runs = NULL;
+    while (fgets (line, sizeof(line), in) != NULL) {
+        lineNum++;
+        s = line + strspn (line, " \t\r\n");
+        if (*s == '\0' || *s == '#') {
+            continue;
+        }
+        if (n == max) {
+            max = max ? 2*max : 256;
+            *runs = realloc (*runs, max * sizeof(Run));
+            if (*runs == NULL) {
+                fprintf (stderr, "Out of memory.\n");
+                exit (1);
+            }
+        }
+        memset (&(*runs)[n], 0, sizeof(Run));
+        for (k=0; k<4 && *s != '\0'; k++) {
+            (*runs)[n].args[k] = strtoul (s, &end, 0);
+            end += strspn (end, " \t\r\n");
+            if (end == s || (*end != ',' && *end != '\0')) {
+                fprintf (stderr, "Bad argument on line %d.\n", lineNum);
+                exit (1);
+            }
+            s = *end == ',' ? end + 1 : end;
+        }
+        if (*s != '\0') {
+            fprintf (stderr, "More than four arguments on line %d.\n", lineNum);
+            exit (1);
+        }
+        n++;
+    }
+    return n;
+}
+
+/*
+ *  Start the copy of the computer for run with its arguments, watching
+ *  for loops if it is on the staged engine; the others catch only
+ *  branches to themselves.
+ */
+static void Setup (Computer* mips, Run *run) {
+    memcpy (&mips->registers[4], run->args, sizeof(run->args));
+    if (mips->engine == STAGED) {
+        mips->loops = NewLoopCheck (mips);
+        if (mips->loops == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+}
+
+/* Note how the run on mips ended. */
+static void Record (Run *run, Computer* mips) {
+    run->halted = mips->halted;
+    run->instrCount = mips->instrCount;
+    run->pc = mips->pc;
+    run->v0 = mips->registers[2];
+    run->done = 1;
+    if (mips->loops != NULL) {
+        FreeLoopCheck (mips->loops);
+        mips->loops = NULL;
+    }
+}
+
+/*
+ *  Child c of numProcs: run every numProcs'th batch of LANES lines,
+ *  starting with batch c, in lockstep.
+ */
+static void RunBatches (Computer* mips, Run *runs, int numRuns, int c, int numProcs,
+  long maxInsns) {
+    Computer *lanes = malloc (LANES * sizeof(Computer));
+    int first, l, m;
+
+    if (lanes == NULL) {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+    }
+    for (first = c*LANES; first < numRuns; first += numProcs*LANES) {
+        m = numRuns - first < LANES ? numRuns - first : LANES;
+        for (l=0; l<m; l++) {
+            if (CopyComputer (&lanes[l], mips) < 0) {
+                fprintf (stderr, "Out of memory.\n");
+                exit (1);
+            }
+            Setup (&lanes[l], &runs[first+l]);
+        }
+        RunLanes (lanes, m, maxInsns);
+        for (l=0; l<m; l++) {
+            Record (&runs[first+l], &lanes[l]);
+            FreeComputer (&lanes[l]);
+        }
+    }
+    free (lanes);
+}
+
+int main (int argc, char *argv[]) {
+    int argIndex, k, numProcs = 4, numRuns, running, lockstep = 0;
+    Engine engine = THREADED;
+    long maxInsns = 100000000, total = 0;
+    Layout layout = LAYOUT_COURSE;
+    Computer mips;
+    Run *inputs, *runs;
+    FILE *filein;
+    pid_t pid;
+
+    for (argIndex=1; argIndex<argc && argv[argIndex][0]=='-'; argIndex++) {
+        switch (argv[argIndex][1]) {
+            case 'p':
+            if (argIndex+1 >= argc || (numProcs = atoi (argv[++argIndex])) < 1) {
+                fprintf (stderr, "-p needs a process count.\n");
+                exit (1);
+            }
+            break;
+            case 'n':
+            if (argIndex+1 >= argc || (maxInsns = atol (argv[++argIndex])) < 1) {
+                fprintf (stderr, "-n needs an instruction limit.\n");
+                exit (1);
+            }
+            break;
+            case 'q':
+            engine = STAGED;
+            break;
+            case 'j':
+            engine = JIT;
+            break;
+            case 's':
+            layout = LAYOUT_SPIM;
+            break;
+            case 'v':
+            lockstep = 1;
+            break;
+            default:
+            fprintf (stderr, "Invalid option \"%s\".\n", argv[argIndex]);
+            fprintf (stderr, "Correct options are -p <procs>, -n <insns>, -q, -j, -s, -v.\n");
+            exit (1);
+        }
+    }
+    if (argIndex != argc-2) {
+        fprintf (stderr, "Usage: simfork [-p procs] [-n insns] [-q|-j] [-s] [-v] file.dump args.csv\n");
+        exit (1);
+    }
+
+    filein = fopen (argv[argIndex+1], "r");
+    if (filein == NULL) {
+        fprintf (stderr, "Can't open file: %s\n", argv[argIndex+1]);
+        exit (1);
+    }
+    numRuns = ReadInputs (filein, &inputs);
+    fclose (filein);
+
+    filein = fopen (argv[argIndex], "r");
+    if (filein == NULL) {
+        fprintf (stderr, "Can't open file: %s\n", argv[argIndex]);
+        exit (1);
+    }
+    if (InitComputer (&mips, filein, layout, 0, 0, 0, 0) < 0) {
+        fprintf (stderr, "Program too big.\n");
+        exit (1);
+    }
+    fclose (filein);
+    mips.engine = engine;
+
+    runs = mmap (NULL, (numRuns > 0 ? numRuns : 1) * sizeof(Run),
+                 PROT_READ|PROT_WRITE, MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if (runs == MAP_FAILED) {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+    }
+    if (numRuns > 0) {
+        memcpy (runs, inputs, numRuns * sizeof(Run));
+    }
+    free (inputs);
+
+    fflush (stdout);
+    running = 0;
+    for (k=0; lockstep && k<numProcs && k*LANES<numRuns; k++) {
+        pid = fork ();
+        if (pid < 0) {
+            fprintf (stderr, "Can't fork.\n");
+            exit (1);
+        }
+        if (pid == 0) {
+            RunBatches (&mips, runs, numRuns, k, numProcs, maxInsns);
+            _exit (0);
+        }
+    }
+    for (k=0; !lockstep && k<numRuns; k++) {
+        if (running == numProcs && wait (NULL) > 0) {
+            running--;
+        }
+        pid = fork ();
+        if (pid < 0) {
+            fprintf (stderr, "Can't fork.\n");
+            exit (1);
+        }
+        if (pid == 0) {
+            Setup (&mips, &runs[k]);
+            StepN (&mips, maxInsns);
+            Record (&runs[k], &mips);
+            _exit (0);
+        }
+        running++;
+    }
+    while (wait (NULL) > 0) {
+    }
+
+    for (k=0; k<numRuns; k++) {
+        printf ("%d,%d,%d,%d: ", runs[k].args[0], runs[k].args[1],
+                runs[k].args[2], runs[k].args[3]);
+        if (!runs[k].done) {
+            printf ("run died\n");
+            continue;
+        }
+        printf ("%s, %ld instructions, pc = %8.8x, $v0 = %8.8x\n",
+                runs[k].halted == RUNNING ? "instruction limit"
+                                          : HaltName (runs[k].halted),
+                runs[k].instrCount, runs[k].pc, runs[k].v0);
+        total += runs[k].instrCount;
+    }
+    printf ("%d runs, %ld instructions\n", numRuns, total);
+    munmap (runs, (numRuns > 0 ? numRuns : 1) * sizeof(Run));
+    FreeComputer (&mips);
+    return 0;
+}
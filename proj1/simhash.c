@@ -0,0 +1,109 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "computer.h"
+#include "statehash.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Find where two runs first went different ways from their hash logs
+ *  (sim --hash-log). The logs are lined up point by point; since a run's
+ *  hash never comes back once it has differed from another's, the
+ *  points where they agree are all before those where they don't, and
+ *  the first disagreement is found by binary search. Unless the points
+ *  are next to each other, that narrows it down to a range of
+ *  instructions, and running both again logging every instruction in
+ *  just that range (--hash-every 1 --hash-from --hash-to) pins it down.
+ */
+
+/* Read the whole log at path; returns the number of points. */
+static long ReadLog (const char *path, HashPoint **points) {
+    FILE *log = fopen (path, "r");
+    long n = 0, max = 0;
+
+    if (log == NULL) {
+        fprintf (stderr, "Can't open file: %s\n", path);
+        exit (1);
+    }
+    *points = NULL;
+    while (1) {
+        if (n == max) {
+            max = max ? 2*max : 1024;
+            *points = realloc (*points, max * sizeof(HashPoint));
+            if (*points == NULL) {
+                fprintf (stderr, "Out of memory.\n");
+                exit (1);
+            }
+        }
+        if (!ReadHashPoint (log, &(*points)[n])) {
+            break;
+        }
+        n++;
+    }
+    fclose (log);
+    if (n == 0) {
+        fprintf (stderr, "Not a hash log: %s\n", path);
+        exit (1);
+    }
+    return n;
+}
+
+static int Same (HashPoint *a, HashPoint *b) {
+    return a->count == b->count && a->hash == b->hash;
+}
+
+int main (int argc, char *argv[]) {
+    HashPoint *a, *b;
+    long na, nb, n, lo, hi, mid, first, last;
+
+    if (argc != 3) {
+        fprintf (stderr, "Usage: simhash run1.log run2.log\n");
+        exit (1);
+    }
+    na = ReadLog (argv[1], &a);
+    nb = ReadLog (argv[2], &b);
+    n = na < nb ? na : nb;
+
+    /* The first point where the logs disagree, or n */
+    lo = 0;
+    hi = n;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (Same (&a[mid], &b[mid])) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if (lo == n && na == nb) {
+        printf ("Runs agree: %ld instructions, state hash %016llx\n",
+                a[n-1].count, a[n-1].hash);
+        return 0;
+    }
+    if (lo == n) {
+        printf ("Runs agree through instruction %ld, where run %d stopped\n",
+                a[n-1].count, na < nb ? 1 : 2);
+        return 1;
+    }
+
+    /* They differ somewhere in (first, last] */
+    first = lo > 0 ? a[lo-1].count : -1;
+    last = a[lo].count < b[lo].count ? a[lo].count : b[lo].count;
+    if (first >= 0 && last == first + 1 && a[lo].count == b[lo].count) {
+        printf ("Runs first differ at instruction %ld: pc %8.8x in run 1, %8.8x in run 2\n",
+                last, a[lo].pc, b[lo].pc);
+    } else if (first >= 0) {
+        printf ("Runs first differ between instructions %ld and %ld\n", first + 1, last);
+        printf ("Rerun both with --hash-every 1 --hash-from %ld --hash-to %ld to find it.\n",
+                first, last);
+    } else if (last == 1) {
+        printf ("Runs first differ at instruction 1: pc %8.8x in run 1, %8.8x in run 2\n",
+                a[lo].pc, b[lo].pc);
+    } else {
+        /* The first log point is only an upper bound */
+        printf ("Runs first differ between instructions 1 and %ld\n", last);
+        printf ("Rerun both with --hash-every 1 --hash-from 0 --hash-to %ld to find it.\n",
+                last);
+    }
+    return 1;
+}
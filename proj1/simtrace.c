@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "computer.h"
+#include "trace.h"
+#undef mips			/* gcc already has a def for mips */
+
+#define TRUE 1
+#define FALSE 0
+
+/*
+ *  Turn a binary trace from sim -t back into the text sim itself would
+ *  have printed, byte for byte. -r and -m work as they do for sim: the
+ *  register file and data memory are rebuilt from the changes recorded
+ *  in the trace, and printed with sim's own PrintInfo().
+ */
+
+static Computer mips;
+
+int main (int argc, char *argv[]) {
+    int argIndex;
+    FILE *filein;
+    TraceHeader h;
+    TraceRecord cur, next;
+    DecodedInstr d;
+    int have, kind, changedReg, changedMem;
+    int printingRegisters = FALSE;
+    int printingMemory = FALSE;
+
+    for (argIndex=1; argIndex<argc && argv[argIndex][0]=='-'; argIndex++) {
+        switch (argv[argIndex][1]) {
+            case 'r':
+            printingRegisters = TRUE;
+            break;
+            case 'm':
+            printingMemory = TRUE;
+            break;
+            default:
+            fprintf (stderr, "Invalid option \"%s\".\n", argv[argIndex]);
+            fprintf (stderr, "Correct options are -r, -m.\n");
+            exit (1);
+        }
+    }
+    if (argIndex != argc-1) {
+        fprintf (stderr, "Usage: simtrace [-r] [-m] tracefile\n");
+        exit (1);
+    }
+
+    filein = fopen (argv[argIndex], "rb");
+    if (filein == NULL) {
+        fprintf (stderr, "Can't open file: %s\n", argv[argIndex]);
+        exit (1);
+    }
+    if (fread (&h, sizeof(h), 1, filein) != 1
+        || h.magic != TRACE_MAGIC || h.version != TRACE_VERSION) {
+        fprintf (stderr, "Not a trace file: %s\n", argv[argIndex]);
+        exit (1);
+    }
+
+    /* Memory starts out zero as far as -m can see; text isn't printed */
+    ClearComputer (&mips, h.layout);
+    mips.registers[29] = h.sp;
+    mips.printingRegisters = printingRegisters;
+    mips.printingMemory = printingMemory;
+
+    have = fread (&cur, sizeof(cur), 1, filein);
+    while (have) {
+        kind = cur.info >> 8;
+        changedReg = (cur.info & 0xff) == 0xff ? -1 : (int) (cur.info & 0xff);
+        changedMem = cur.changedMem;
+        if (kind == TRACE_FETCH) {
+            printf("Memory Access Exception at 0x%.8x: address 0x%.8x\n", cur.pc, changedMem);
+            break;
+        }
+
+        printf ("Executing instruction at %8.8x: %8.8x\n", cur.pc, cur.instr);
+        Decode (cur.instr, cur.pc, &d);
+        PrintInstruction (&d);
+        if (kind == TRACE_UNSUPPORTED) {
+            break;
+        } else if (kind == TRACE_MEMORY) {
+            printf("Memory Access Exception at 0x%.8x: address 0x%.8x\n", cur.pc, changedMem);
+            break;
+        }
+
+        if (changedReg != -1) {
+            mips.registers[changedReg] = cur.value;
+        } else if (changedMem != -1) {
+            WriteWord (&mips, changedMem, cur.value);
+        }
+
+        /* The new pc is where the next record is; none means cut short */
+        have = fread (&next, sizeof(next), 1, filein);
+        if (!have) {
+            break;
+        }
+        mips.pc = next.pc;
+        PrintInfo (&mips, changedReg, changedMem);
+        cur = next;
+    }
+    fclose (filein);
+    FreeComputer (&mips);
+    return 0;
+}
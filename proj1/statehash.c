@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include "computer.h"
+#include "statehash.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Each instruction folds its pc, then (register number, value) if it
+ *  wrote a register, then (address, value) if it wrote memory, into the
+ *  hash, one 64-bit word at a time: xor the word in, then multiply by an
+ *  odd constant and xor the high half down. Both of those are one-to-one,
+ *  so once two runs' hashes differ, they stay different for as long as
+ *  the runs do the same thing; the instruction where they first differ
+ *  is where the runs first did something different. That is what lets
+ *  simhash binary search two logs.
+ *
+ *  The log is text, a line per point: the instruction count, the pc of
+ *  the instruction that got it there and the hash after it, every
+ *  every'th instruction between from and to, and once more when the run
+ *  ends.
+ */
+
+struct StateHash {
+    FILE *log;
+    long every, from, to;
+    long lastLogged;		/* count of the latest line, or -1 */
+    int lastPc;			/* of the latest instruction hashed */
+    unsigned long long hash;
+};
+
+StateHash *NewStateHash (FILE *log, long every, long from, long to) {
+    StateHash *h = calloc (1, sizeof(StateHash));
+
+    if (h == NULL) {
+        return NULL;
+    }
+    h->log = log;
+    h->every = every;
+    h->from = from;
+    h->to = to;
+    h->lastLogged = -1;
+    h->lastPc = -1;
+    h->hash = 0x6a09e667f3bcc908ULL;
+    return h;
+}
+
+static inline unsigned long long Fold (unsigned long long hash, unsigned long long word) {
+    hash = (hash ^ word) * 0x9e3779b97f4a7c15ULL;
+    return hash ^ (hash >> 32);
+}
+
+static void LogPoint (StateHash *h, long count, unsigned int pc) {
+    if (h->log != NULL && count != h->lastLogged) {
+        fprintf (h->log, "%ld %8.8x %016llx\n", count, pc, h->hash);
+        h->lastLogged = count;
+    }
+}
+
+/*
+ *  Account for the instruction at pc having been executed, with
+ *  changedReg and changedMem as for PrintInfo().
+ */
+void HashStep (StateHash *h, Computer* mips, int pc, int changedReg, int changedMem) {
+    unsigned long long hash = Fold (h->hash, (unsigned int) pc);
+
+    if (changedReg != -1) {
+        hash = Fold (hash, (unsigned long long) changedReg << 32
+                           | (unsigned int) mips->registers[changedReg]);
+    }
+    if (changedMem != -1) {
+        hash = Fold (hash, (unsigned long long) (unsigned int) changedMem << 32
+                           | Fetch (mips, changedMem));
+    }
+    h->hash = hash;
+    h->lastPc = pc;
+    if (mips->instrCount % h->every == 0 && mips->instrCount >= h->from
+        && mips->instrCount <= h->to) {
+        LogPoint (h, mips->instrCount, pc);
+    }
+}
+
+/* Log where the run ended and print the final hash. */
+void FinishStateHash (StateHash *h, Computer* mips) {
+    LogPoint (h, mips->instrCount, h->lastPc);
+    printf ("State hash after %ld instructions: %016llx\n", mips->instrCount, h->hash);
+}
+
+void FreeStateHash (StateHash *h) {
+    free (h);
+}
+
+/* Read the next line of a hash log into point; returns 0 at the end. */
+int ReadHashPoint (FILE *log, HashPoint *point) {
+    return fscanf (log, "%ld %x %llx", &point->count, &point->pc, &point->hash) == 3;
+}
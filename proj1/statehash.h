@@ -0,0 +1,23 @@
+/*
+ *  A rolling 64-bit hash of everything a run does: for each instruction,
+ *  its pc and the register and memory word it changed, with their new
+ *  values. Two runs that hash the same did the same thing, so runs can
+ *  be compared by their hash logs instead of their traces; see simhash.
+ *  Include computer.h first.
+ */
+
+typedef struct StateHash StateHash;
+
+StateHash *NewStateHash (FILE *log, long every, long from, long to);
+void HashStep (StateHash*, Computer*, int pc, int changedReg, int changedMem);
+void FinishStateHash (StateHash*, Computer*);
+void FreeStateHash (StateHash*);
+
+/* One line of a hash log */
+typedef struct {
+    long count;			/* instructions executed */
+    unsigned int pc;		/* of the last of them */
+    unsigned long long hash;	/* after it */
+} HashPoint;
+
+int ReadHashPoint (FILE *log, HashPoint *point);
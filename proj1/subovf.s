@@ -0,0 +1,11 @@
+# sub overflow, for sim -x: 0x80000000 - 1 stops the program at the
+# sub, with $t2 left alone. (fullisa.s ends with an add overflow.)
+#
+#	sim -x subovf.dump
+
+		.text
+		lui	$t0,0x8000
+		addiu	$t1,$0,1
+		addiu	$t2,$0,7
+		sub	$t2,$t0,$t1
+		addiu	$t3,$0,1		# never reached
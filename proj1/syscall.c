@@ -0,0 +1,165 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+#include "loop.h"
+#include "undo.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  SPIM's system calls, for the full instruction set: the service
+ *  number is in $v0 and the argument in $a0, and read_int and sbrk
+ *  return their result in $v0.
+ *
+ *    1  print_int     $a0 in decimal
+ *    4  print_string  the NUL-terminated string at $a0
+ *    5  read_int      a line of standard input, as a decimal number
+ *    9  sbrk          $a0 more bytes of heap; returns where they start
+ *   10  exit          stops the program with HALT_EXIT
+ *
+ *  Anything else stops it as an unsupported instruction.
+ *
+ *  A run's output collects in a buffer of its own, which is written out
+ *  when it fills, before reading input, when the run ends and when the
+ *  computer is freed, so a program printing a lot costs a write() now
+ *  and then rather than one per syscall. When the run is being traced
+ *  or stepped through, it is written out straight away instead, so it
+ *  comes out in order with the trace. When the undo log runs part of a
+ *  run again (see undo.c), nothing is printed a second time and
+ *  read_int gets the numbers it read the first time round.
+ *
+ *  The heap starts out empty; sbrk moves the break up, and the heap
+ *  region with it a page at a time. Like the rest of memory, its pages
+ *  are only allocated when they are first written.
+ */
+
+#define CONSOLE_BYTES (1 << 20)	/* output buffered per computer */
+
+typedef struct Console {
+    int used;
+    char buf [CONSOLE_BYTES];
+} Console;
+
+void FlushConsole (Computer* mips) {
+    if (mips->console != NULL && mips->console->used > 0) {
+        fwrite (mips->console->buf, 1, mips->console->used, stdout);
+        mips->console->used = 0;
+        fflush (stdout);
+    }
+}
+
+void FreeConsole (Computer* mips) {
+    FlushConsole (mips);
+    free (mips->console);
+    mips->console = NULL;
+}
+
+/* Add n bytes of program output, unless it came out the first time. */
+static void Output (Computer* mips, const char *s, int n) {
+    Console *c = mips->console;
+    int k;
+
+    if (mips->undo != NULL && UndoReplaying (mips->undo)) {
+        return;
+    }
+    if (c == NULL) {
+        c = mips->console = malloc (sizeof(Console));
+        if (c == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+        c->used = 0;
+    }
+    while (n > 0) {
+        if (c->used == CONSOLE_BYTES) {
+            FlushConsole (mips);
+        }
+        k = n < CONSOLE_BYTES - c->used ? n : CONSOLE_BYTES - c->used;
+        memcpy (c->buf + c->used, s, k);
+        c->used += k;
+        s += k;
+        n -= k;
+    }
+}
+
+/* print_string: returns 0, with mips->halted set, if it runs off memory */
+static int PrintString (Computer* mips, unsigned int addr) {
+    char chunk[256];
+    int n = 0;
+
+    while (1) {
+        if (!IsMapped (mips, addr & ~3)) {
+            mips->halted = HALT_MEMORY;
+            mips->haltAddr = addr;
+            return 0;
+        }
+        chunk[n] = Fetch (mips, addr & ~3) >> (8 * (addr & 3));
+        if (chunk[n] == '\0') {
+            break;
+        }
+        addr++;
+        if (++n == sizeof(chunk)) {
+            Output (mips, chunk, n);
+            n = 0;
+        }
+    }
+    Output (mips, chunk, n);
+    return 1;
+}
+
+/* sbrk: where the n more bytes start, or -1 if there isn't room */
+static int Sbrk (Computer* mips, int n) {
+    Region *heap = &mips->regions[SEG_HEAP], *stack = &mips->regions[SEG_STACK];
+    unsigned int start = mips->heapBreak;
+    unsigned int top = stack->base > heap->base ? stack->base : 0x80000000;
+
+    if (n < 0 || n > top - start) {
+        return -1;
+    }
+    mips->heapBreak += n;
+    heap->limit = (mips->heapBreak + 4*PAGEWORDS-1) & ~(4*PAGEWORDS-1);
+    return start;
+}
+
+int Syscall (Computer* mips, DecodedInstr* d, RegVals* v) {
+    int a0 = mips->registers[4], v0 = mips->registers[2];
+    char s[40];
+
+    switch (v0) {
+        case 1:
+            Output (mips, s, sprintf (s, "%d", a0));
+            break;
+        case 4:
+            if (!PrintString (mips, a0)) {
+                return v0;
+            }
+            break;
+        case 5:
+            if (mips->undo != NULL && UndoReplaying (mips->undo)) {
+                return UndoNextInput (mips->undo);
+            }
+            FlushConsole (mips);
+            v0 = fgets (s, sizeof(s), stdin) != NULL ? atoi (s) : 0;
+            if (mips->undo != NULL) {
+                UndoNoteInput (mips->undo, v0);
+            }
+            if (mips->loops != NULL) {
+                /* the same state can now go another way */
+                RestartLoopCheck (mips->loops);
+            }
+            return v0;
+        case 9:
+            return Sbrk (mips, a0);
+        case 10:
+            mips->halted = HALT_EXIT;
+            mips->haltAddr = mips->pc;
+            return v0;
+        default:
+            mips->halted = HALT_UNSUPPORTED;
+            return v0;
+    }
+    if (!mips->quiet || mips->interactive) {
+        FlushConsole (mips);
+    }
+    return v0;
+}
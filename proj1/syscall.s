@@ -0,0 +1,54 @@
+# SPIM's syscalls, for sim -x: print_string, read_int, print_int, sbrk
+# and exit. Reads a number and prints twice it, then the start of two
+# sbrk(16)s and the word stored in the heap, then exits.
+#
+#	sim -x -s -q syscall.dump < syscall.input
+
+		.text
+		lui	$s0,0x1001
+		lui	$t0,0x626d		# "Number? "
+		ori	$t0,$t0,0x754e
+		sw	$t0,0($s0)
+		lui	$t0,0x203f
+		ori	$t0,$t0,0x7265
+		sw	$t0,4($s0)
+		addiu	$t0,$0,10		# "\n"
+		sw	$t0,12($s0)
+
+		or	$a0,$s0,$0		# print_string "Number? "
+		addiu	$v0,$0,4
+		syscall
+		addiu	$v0,$0,5		# read_int
+		syscall
+		addu	$a0,$v0,$v0		# print_int twice it
+		jal	Print
+
+		addiu	$a0,$0,16		# sbrk(16): the heap base
+		addiu	$v0,$0,9
+		syscall
+		or	$s1,$v0,$0
+		or	$a0,$v0,$0
+		jal	Print
+		addiu	$a0,$0,16		# sbrk(16): 16 more
+		addiu	$v0,$0,9
+		syscall
+		or	$a0,$v0,$0
+		jal	Print
+		addiu	$t0,$0,1234		# the heap can be used
+		sw	$t0,20($s1)
+		lw	$a0,20($s1)
+		jal	Print
+
+		addiu	$v0,$0,10		# exit
+		syscall
+		addiu	$a0,$0,99		# never reached
+		jal	Print
+
+# print_int $a0 and a newline
+Print:
+		addiu	$v0,$0,1
+		syscall
+		addiu	$a0,$s0,12
+		addiu	$v0,$0,4
+		syscall
+		jr	$ra
@@ -0,0 +1,550 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include "computer.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  Threaded-code execution engine.
+ *
+ *  The staged path in computer.c walks every instruction through
+ *  Execute(), UpdatePC(), Mem() and RegWrite(), each of which switches
+ *  on op and funct again. Here each instruction kind has one handler
+ *  that does all four stages, and every text word is bound to its
+ *  handler's address up front, so moving to the next instruction is a
+ *  single computed goto (a GNU C extension, like the rest of the build).
+ *
+ *  A few common pairs of instructions get a fused handler that does
+ *  both for one dispatch: lui+ori building a constant, slt followed by
+ *  a branch, addiu followed by a branch or j closing a loop, and addu+j.
+ *  The first word of such a pair is bound to the fused handler and the
+ *  second keeps its own, so jumping straight to it still works. A fused
+ *  handler does the first instruction alone if mips->stopAt falls
+ *  between the two. Only this engine fuses; the staged path, which
+ *  prints and traces each instruction, is left alone.
+ *
+ *  Likewise a beq heading a counted loop (see FindLoop()) gets a handler
+ *  that works out from the registers how many more times the loop will
+ *  go round, and does all of those trips at once: each register the
+ *  body adds to gets trips times the amount. Loops that load or store,
+ *  or do anything else, run an instruction at a time.
+ *
+ *  A taken beq, bne, j or jr whose target is itself can only go round
+ *  forever, so unless mips->selfLoops is off it stops the run with
+ *  HALT_LOOP, as the staged engine's LoopCheck would.
+ *
+ *  The handlers must do exactly what the stages do, including writing
+ *  register 0. Nothing is printed per instruction; the run ends with
+ *  mips->halted set and mips->pc at the instruction that stopped it, or
+ *  with mips->pc at the next instruction once mips->stopAt is reached.
+ */
+
+/* Handler numbers, in the same order as the labels in RunThreaded() */
+enum {
+    H_SLL, H_SRL, H_JR, H_ADDU, H_SUBU, H_AND, H_OR, H_SLT, H_NOP,
+    H_J, H_JAL, H_BEQ, H_BNE, H_ADDIU, H_ANDI, H_ORI, H_LUI, H_LW, H_SW,
+    H_UNSUPPORTED,
+    H_LUI_ORI, H_SLT_BEQ, H_SLT_BNE, H_ADDIU_BEQ, H_ADDIU_BNE, H_ADDIU_J,
+    H_ADDU_J, H_COUNTED
+};
+
+#define MAXLOOP 16		/* longest loop body that is fast-forwarded */
+
+/* What one trip round a counted loop does */
+typedef struct {
+    int length;			/* instructions per trip, with the beq and j */
+    int numUpdates;
+    int reg [MAXLOOP];		/* register each body instruction adds to */
+    int stepReg [MAXLOOP];	/* register it adds, or -1 for imm */
+    int negate [MAXLOOP];	/* it subtracts stepReg instead */
+    int imm [MAXLOOP];
+} Loop;
+
+/* Pick the handler for a decoded instruction. */
+static int HandlerFor (DecodedInstr* d) {
+    switch (d -> op) {
+        case 0:
+            switch (d -> regs.r.funct) {
+                case 0: return H_SLL;
+                case 2: return H_SRL;
+                case 8: return H_JR;
+                case 33: return H_ADDU;
+                case 35: return H_SUBU;
+                case 36: return H_AND;
+                case 37: return H_OR;
+                case 42: return H_SLT;
+                default: return H_NOP; /* the stages ignore these too */
+            }
+        case 2: return H_J;
+        case 3: return H_JAL;
+        case 4: return H_BEQ;
+        case 5: return H_BNE;
+        case 9: return H_ADDIU;
+        case 12: return H_ANDI;
+        case 13: return H_ORI;
+        case 15: return H_LUI;
+        case 35: return H_LW;
+        case 43: return H_SW;
+        default: return H_UNSUPPORTED;
+    }
+}
+
+/*
+ *  The fused handler for d followed by next, or -1 if there isn't one.
+ *  The handlers work whatever registers the two use.
+ */
+static int FusedHandler (DecodedInstr* d, DecodedInstr* next) {
+    int first = HandlerFor (d), second = HandlerFor (next);
+
+    if (first == H_LUI && second == H_ORI) {
+        return H_LUI_ORI;
+    } else if (first == H_SLT && second == H_BEQ) {
+        return H_SLT_BEQ;
+    } else if (first == H_SLT && second == H_BNE) {
+        return H_SLT_BNE;
+    } else if (first == H_ADDIU && second == H_BEQ) {
+        return H_ADDIU_BEQ;
+    } else if (first == H_ADDIU && second == H_BNE) {
+        return H_ADDIU_BNE;
+    } else if (first == H_ADDIU && second == H_J) {
+        return H_ADDIU_J;
+    } else if (first == H_ADDU && second == H_J) {
+        return H_ADDU_J;
+    }
+    return -1;
+}
+
+/*
+ *  Whether d, the first of wordsLeft text words and at address pc, heads
+ *  a counted loop: a beq, then at most MAXLOOP instructions that each
+ *  add to a register something the loop doesn't change (addu or subu
+ *  rd,rd,rt, or addiu rt,rt,imm; no register twice), then a j back to
+ *  the beq. If so, loop is filled in.
+ */
+static int FindLoop (DecodedInstr* d, unsigned int wordsLeft, unsigned int pc,
+  Loop *loop) {
+    DecodedInstr *e;
+    unsigned int written = 0;
+    int i, r, n = 0;
+
+    if (HandlerFor (d) != H_BEQ) {
+        return 0;
+    }
+    for (i=1; ; i++) {
+        if (i >= wordsLeft || n == MAXLOOP) {
+            return 0;
+        }
+        e = &d[i];
+        loop->negate[n] = 0;
+        loop->imm[n] = 0;
+        switch (HandlerFor (e)) {
+            case H_J:
+                if (e->regs.j.target != pc) {
+                    return 0;
+                }
+                for (r=0; r<n; r++) {
+                    if (loop->stepReg[r] >= 0 && (written & (1u << loop->stepReg[r]))) {
+                        return 0;
+                    }
+                }
+                loop->length = i + 1;
+                loop->numUpdates = n;
+                return 1;
+            case H_ADDIU:
+                if (e->regs.i.rs != e->regs.i.rt) {
+                    return 0;
+                }
+                loop->reg[n] = e->regs.i.rt;
+                loop->stepReg[n] = -1;
+                loop->imm[n] = e->regs.i.addr_or_immed;
+                break;
+            case H_ADDU:
+            case H_SUBU:
+                loop->reg[n] = e->regs.r.rd;
+                if (e->regs.r.rs == e->regs.r.rd && e->regs.r.rt != e->regs.r.rd) {
+                    loop->stepReg[n] = e->regs.r.rt;
+                    loop->negate[n] = HandlerFor (e) == H_SUBU;
+                } else if (HandlerFor (e) == H_ADDU && e->regs.r.rt == e->regs.r.rd
+                           && e->regs.r.rs != e->regs.r.rd) {
+                    loop->stepReg[n] = e->regs.r.rs;
+                } else {
+                    return 0;
+                }
+                break;
+            default:
+                return 0;
+        }
+        if (written & (1u << loop->reg[n])) {
+            return 0;
+        }
+        written |= 1u << loop->reg[n];
+        n++;
+    }
+}
+
+/* How much one trip round the loop adds to register r */
+static unsigned int LoopStep (Loop *loop, int *reg, int r) {
+    int i;
+
+    for (i=0; i<loop->numUpdates; i++) {
+        if (loop->reg[i] == r) {
+            if (loop->stepReg[i] < 0) {
+                return loop->imm[i];
+            }
+            return loop->negate[i] ? -(unsigned int) reg[loop->stepReg[i]]
+                                   : (unsigned int) reg[loop->stepReg[i]];
+        }
+    }
+    return 0;
+}
+
+/*
+ *  How many trips the loop makes before its beq on registers a and b is
+ *  taken, or LONG_MAX if it never is: the least n with
+ *  a + n*stepA = b + n*stepB mod 2^32.
+ */
+static long Trips (Loop *loop, int *reg, int a, int b) {
+    unsigned int step = LoopStep (loop, reg, a) - LoopStep (loop, reg, b);
+    unsigned int gap = (unsigned int) reg[b] - (unsigned int) reg[a];
+    unsigned int odd, inverse;
+    int t, i;
+
+    if (gap == 0) {
+        return 0;
+    }
+    if (step == 0) {
+        return LONG_MAX;
+    }
+    t = __builtin_ctz (step);
+    if (gap & ((1u << t) - 1)) {
+        return LONG_MAX;
+    }
+    /* Newton's iteration for the inverse of odd mod 2^32 */
+    odd = step >> t;
+    inverse = odd;
+    for (i=0; i<5; i++) {
+        inverse *= 2 - odd * inverse;
+    }
+    return (gap >> t) * inverse & (0xffffffffu >> t);
+}
+
+/*
+ *  Bind text word k to its handler: the counted loop handler if it
+ *  heads one, else fused with the next word's if it can be.
+ */
+static void Bind (void **code, void **labels, DecodedInstr* decoded,
+  unsigned int k, unsigned int textWords, unsigned int textBase) {
+    Loop loop;
+    int h = k+1 < textWords ? FusedHandler (&decoded[k], &decoded[k+1]) : -1;
+
+    if (FindLoop (&decoded[k], textWords - k, textBase + 4*k, &loop)) {
+        h = H_COUNTED;
+    }
+    code[k] = labels[h >= 0 ? h : HandlerFor (&decoded[k])];
+}
+
+/*
+ *  Run from mips->pc until the program stops or mips->instrCount
+ *  reaches mips->stopAt.
+ */
+void RunThreaded (Computer* mips) {
+    static void *labels[] = {
+        &&sll, &&srl, &&jr, &&addu, &&subu, &&and, &&or, &&slt, &&nop,
+        &&j, &&jal, &&beq, &&bne, &&addiu, &&andi, &&ori, &&lui, &&lw, &&sw,
+        &&unsupported,
+        &&lui_ori, &&slt_beq, &&slt_bne, &&addiu_beq, &&addiu_bne, &&addiu_j,
+        &&addu_j, &&counted
+    };
+    void **code;		/* handler bound to each text word */
+    int *reg = mips->registers;
+    int *page;
+    DecodedInstr *d, scratch;
+    Loop loop;
+    unsigned int pc, k, addr, i;
+    long trips;
+    unsigned int textBase = mips->regions[SEG_TEXT].base;
+    unsigned int textWords = mips->textWords;
+    long count = mips->instrCount, stopAt = mips->stopAt;
+    int selfLoops = mips->selfLoops;
+
+    code = malloc (textWords * sizeof(void *));
+    if (code == NULL) {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+    }
+    for (k=0; k<textWords; k++) {
+        Bind (code, labels, mips->decoded, k, textWords, textBase);
+    }
+
+/*
+ * Move to the instruction at pc. Text words jump straight through code[];
+ * anything else takes the out-of-line path, which bounds-checks the
+ * fetch and decodes on the spot like Simulate() does.
+ */
+#define DISPATCH() \
+    do { \
+        if (count >= stopAt) goto done; \
+        k = (pc - textBase) >> 2; \
+        if (k >= textWords || pc % 4 != 0) goto outside; \
+        d = &mips->decoded[k]; \
+        count++; \
+        goto *code[k]; \
+    } while (0)
+
+/*
+ * Point page at the page holding a, or check that a is a word in a
+ * mapped region whose page hasn't been allocated yet, which leaves page
+ * NULL. The same test Mem() applies to lw and sw. Only a store
+ * allocates (alloc set); a load of a page that has never been written
+ * reads zero without touching the page table.
+ */
+#define CHECKADDR(a, alloc) \
+    do { \
+        page = PageOf (mips, (a)); \
+        if (page == NULL || (a) % 4 != 0) { \
+            if (!IsMapped (mips, (a))) { \
+                mips->haltAddr = (a); \
+                goto memerror; \
+            } \
+            if (alloc) { \
+                page = AllocPage (mips, (a)); \
+            } \
+        } \
+    } while (0)
+
+/*
+ * Count the second instruction of a fused pair, or do just the first,
+ * with its own handler, if that would go past stopAt.
+ */
+#define SECOND(single) \
+    do { \
+        if (count >= stopAt) goto single; \
+        count++; \
+    } while (0)
+
+    pc = mips->pc;
+    DISPATCH();
+
+sll:
+    reg[d->regs.r.rd] = (unsigned int) reg[d->regs.r.rt] << d->regs.r.shamt;
+    pc += 4;
+    DISPATCH();
+srl:
+    reg[d->regs.r.rd] = (unsigned int) reg[d->regs.r.rt] >> d->regs.r.shamt;
+    pc += 4;
+    DISPATCH();
+jr:
+    if (reg[d->regs.r.rs] == pc && selfLoops) goto stuck;
+    pc = reg[d->regs.r.rs];
+    DISPATCH();
+addu:
+    reg[d->regs.r.rd] = (unsigned int) reg[d->regs.r.rs] + reg[d->regs.r.rt];
+    pc += 4;
+    DISPATCH();
+subu:
+    reg[d->regs.r.rd] = (unsigned int) reg[d->regs.r.rs] - reg[d->regs.r.rt];
+    pc += 4;
+    DISPATCH();
+and:
+    reg[d->regs.r.rd] = reg[d->regs.r.rs] & reg[d->regs.r.rt];
+    pc += 4;
+    DISPATCH();
+or:
+    reg[d->regs.r.rd] = reg[d->regs.r.rs] | reg[d->regs.r.rt];
+    pc += 4;
+    DISPATCH();
+slt:
+    reg[d->regs.r.rd] = reg[d->regs.r.rs] < reg[d->regs.r.rt];
+    pc += 4;
+    DISPATCH();
+nop:
+    pc += 4;
+    DISPATCH();
+j:
+    if (d->regs.j.target == pc && selfLoops) goto stuck;
+    pc = d->regs.j.target;
+    DISPATCH();
+jal:
+    reg[31] = pc + 4;
+    pc = d->regs.j.target;
+    DISPATCH();
+beq:
+    if (reg[d->regs.i.rs] == reg[d->regs.i.rt]) {
+        if (d->regs.i.addr_or_immed == pc && selfLoops) goto stuck;
+        pc = d->regs.i.addr_or_immed;
+    } else {
+        pc += 4;
+    }
+    DISPATCH();
+bne:
+    if (reg[d->regs.i.rs] != reg[d->regs.i.rt]) {
+        if (d->regs.i.addr_or_immed == pc && selfLoops) goto stuck;
+        pc = d->regs.i.addr_or_immed;
+    } else {
+        pc += 4;
+    }
+    DISPATCH();
+addiu:
+    reg[d->regs.i.rt] = (unsigned int) reg[d->regs.i.rs] + d->regs.i.addr_or_immed;
+    pc += 4;
+    DISPATCH();
+andi:
+    reg[d->regs.i.rt] = reg[d->regs.i.rs] & d->regs.i.addr_or_immed;
+    pc += 4;
+    DISPATCH();
+ori:
+    reg[d->regs.i.rt] = reg[d->regs.i.rs] | d->regs.i.addr_or_immed;
+    pc += 4;
+    DISPATCH();
+lui:
+    reg[d->regs.i.rt] = (unsigned int) d->regs.i.addr_or_immed << 16;
+    pc += 4;
+    DISPATCH();
+lw:
+    addr = reg[d->regs.i.rs] + d->regs.i.addr_or_immed;
+    CHECKADDR(addr, 0);
+    reg[d->regs.i.rt] = page ? page[(addr >> 2) & 1023] : 0;
+    pc += 4;
+    DISPATCH();
+sw:
+    addr = reg[d->regs.i.rs] + d->regs.i.addr_or_immed;
+    CHECKADDR(addr, 1);
+    page[(addr >> 2) & 1023] = reg[d->regs.i.rt];
+    if (addr - textBase < 4*textWords) {
+        /*
+         * self-modifying code: rebind the overwritten word and any pair
+         * or loop it is part of
+         */
+        Predecode (mips, addr);
+        k = (addr - textBase) >> 2;
+        for (i = k > MAXLOOP+1 ? k-MAXLOOP-1 : 0; i <= k; i++) {
+            Bind (code, labels, mips->decoded, i, textWords, textBase);
+        }
+    }
+    pc += 4;
+    DISPATCH();
+
+lui_ori:
+    SECOND(lui);
+    reg[d->regs.i.rt] = (unsigned int) d->regs.i.addr_or_immed << 16;
+    reg[d[1].regs.i.rt] = reg[d[1].regs.i.rs] | d[1].regs.i.addr_or_immed;
+    pc += 8;
+    DISPATCH();
+slt_beq:
+    SECOND(slt);
+    reg[d->regs.r.rd] = reg[d->regs.r.rs] < reg[d->regs.r.rt];
+    if (reg[d[1].regs.i.rs] == reg[d[1].regs.i.rt]) {
+        if (d[1].regs.i.addr_or_immed == pc + 4 && selfLoops) {
+            pc += 4;
+            goto stuck;
+        }
+        pc = d[1].regs.i.addr_or_immed;
+    } else {
+        pc += 8;
+    }
+    DISPATCH();
+slt_bne:
+    SECOND(slt);
+    reg[d->regs.r.rd] = reg[d->regs.r.rs] < reg[d->regs.r.rt];
+    if (reg[d[1].regs.i.rs] != reg[d[1].regs.i.rt]) {
+        if (d[1].regs.i.addr_or_immed == pc + 4 && selfLoops) {
+            pc += 4;
+            goto stuck;
+        }
+        pc = d[1].regs.i.addr_or_immed;
+    } else {
+        pc += 8;
+    }
+    DISPATCH();
+addiu_beq:
+    SECOND(addiu);
+    reg[d->regs.i.rt] = (unsigned int) reg[d->regs.i.rs] + d->regs.i.addr_or_immed;
+    if (reg[d[1].regs.i.rs] == reg[d[1].regs.i.rt]) {
+        if (d[1].regs.i.addr_or_immed == pc + 4 && selfLoops) {
+            pc += 4;
+            goto stuck;
+        }
+        pc = d[1].regs.i.addr_or_immed;
+    } else {
+        pc += 8;
+    }
+    DISPATCH();
+addiu_bne:
+    SECOND(addiu);
+    reg[d->regs.i.rt] = (unsigned int) reg[d->regs.i.rs] + d->regs.i.addr_or_immed;
+    if (reg[d[1].regs.i.rs] != reg[d[1].regs.i.rt]) {
+        if (d[1].regs.i.addr_or_immed == pc + 4 && selfLoops) {
+            pc += 4;
+            goto stuck;
+        }
+        pc = d[1].regs.i.addr_or_immed;
+    } else {
+        pc += 8;
+    }
+    DISPATCH();
+addiu_j:
+    SECOND(addiu);
+    reg[d->regs.i.rt] = (unsigned int) reg[d->regs.i.rs] + d->regs.i.addr_or_immed;
+    if (d[1].regs.j.target == pc + 4 && selfLoops) {
+        pc += 4;
+        goto stuck;
+    }
+    pc = d[1].regs.j.target;
+    DISPATCH();
+addu_j:
+    SECOND(addu);
+    reg[d->regs.r.rd] = (unsigned int) reg[d->regs.r.rs] + reg[d->regs.r.rt];
+    if (d[1].regs.j.target == pc + 4 && selfLoops) {
+        pc += 4;
+        goto stuck;
+    }
+    pc = d[1].regs.j.target;
+    DISPATCH();
+counted:
+    /*
+     * Skip the trips that stay in the loop, as many as stopAt leaves room
+     * for, then do the beq as usual. It was counted on the way in, and
+     * so is the one that starts each trip.
+     */
+    if (FindLoop (d, textWords - k, pc, &loop)) {
+        trips = Trips (&loop, reg, d->regs.i.rs, d->regs.i.rt);
+        if (trips > (stopAt - count) / loop.length) {
+            trips = (stopAt - count) / loop.length;
+        }
+        for (i=0; i<loop.numUpdates; i++) {
+            reg[loop.reg[i]] += (unsigned int) trips * LoopStep (&loop, reg, loop.reg[i]);
+        }
+        count += trips * loop.length;
+    }
+    goto beq;
+
+outside:
+    if (!IsMapped (mips, pc)) {
+        mips->haltAddr = pc;
+        mips->halted = HALT_MEMORY;
+        goto done;
+    }
+    d = &scratch;
+    Decode (Fetch (mips, pc), pc, d);
+    count++;
+    goto *labels[HandlerFor (d)];
+
+memerror:
+    count--;
+    mips->halted = HALT_MEMORY;
+    goto done;
+unsupported:
+    count--;
+    mips->halted = HALT_UNSUPPORTED;
+    goto done;
+stuck:
+    /* counted, like the staged engine, and pc is already the target */
+    mips->halted = HALT_LOOP;
+done:
+    mips->pc = pc;
+    mips->instrCount = count;
+    free (code);
+#undef DISPATCH
+#undef CHECKADDR
+#undef SECOND
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "trace.h"
+
+/*
+ *  Double-buffered trace writer. The simulator fills one buffer while a
+ *  writer thread hands the other to fwrite, so the run only ever waits
+ *  on the disk if it gets a whole buffer ahead of it.
+ */
+
+#define TRACE_BUFRECS (1<<18)	/* records per buffer, 5 MiB */
+
+struct TraceWriter {
+    FILE *file;
+    TraceRecord *buf[2];
+    int cur;			/* buffer the simulator is filling */
+    int used;			/* records in buf[cur] */
+    int full;			/* buffer handed to the writer */
+    int pending;		/* records in buf[full] not yet written */
+    int closing;		/* no more buffers are coming */
+    int error;
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static void *WriterThread (void *arg) {
+    TraceWriter *t = arg;
+    int n;
+
+    pthread_mutex_lock (&t->lock);
+    while (1) {
+        while (t->pending == 0 && !t->closing) {
+            pthread_cond_wait (&t->cond, &t->lock);
+        }
+        if (t->pending == 0) {
+            break;
+        }
+        n = t->pending;
+        pthread_mutex_unlock (&t->lock);
+        if (fwrite (t->buf[t->full], sizeof(TraceRecord), n, t->file) != n) {
+            t->error = 1;
+        }
+        pthread_mutex_lock (&t->lock);
+        t->pending = 0;
+        pthread_cond_broadcast (&t->cond);
+    }
+    pthread_mutex_unlock (&t->lock);
+    return NULL;
+}
+
+/* Give the filled buffer to the writer and start on the other one. */
+static void HandOff (TraceWriter *t) {
+    pthread_mutex_lock (&t->lock);
+    while (t->pending) {
+        pthread_cond_wait (&t->cond, &t->lock);
+    }
+    t->full = t->cur;
+    t->pending = t->used;
+    pthread_cond_broadcast (&t->cond);
+    pthread_mutex_unlock (&t->lock);
+    t->cur = !t->cur;
+    t->used = 0;
+}
+
+/*
+ *  Create the trace file at path and start its writer thread. Returns
+ *  NULL if either can't be done.
+ */
+TraceWriter *OpenTrace (const char *path, unsigned int sp, unsigned int layout) {
+    TraceWriter *t;
+    TraceHeader h;
+
+    t = calloc (1, sizeof(TraceWriter));
+    if (t == NULL) {
+        return NULL;
+    }
+    t->file = fopen (path, "wb");
+    t->buf[0] = malloc (TRACE_BUFRECS * sizeof(TraceRecord));
+    t->buf[1] = malloc (TRACE_BUFRECS * sizeof(TraceRecord));
+    h.magic = TRACE_MAGIC;
+    h.version = TRACE_VERSION;
+    h.sp = sp;
+    h.layout = layout;
+    if (t->file == NULL || t->buf[0] == NULL || t->buf[1] == NULL
+        || fwrite (&h, sizeof(h), 1, t->file) != 1) {
+        goto fail;
+    }
+    pthread_mutex_init (&t->lock, NULL);
+    pthread_cond_init (&t->cond, NULL);
+    if (pthread_create (&t->thread, NULL, WriterThread, t) != 0) {
+        goto fail;
+    }
+    return t;
+
+fail:
+    if (t->file != NULL) {
+        fclose (t->file);
+    }
+    free (t->buf[0]);
+    free (t->buf[1]);
+    free (t);
+    return NULL;
+}
+
+/* Append a record for the instruction at pc. */
+void TraceStep (TraceWriter *t, unsigned int pc, unsigned int instr,
+  int changedReg, unsigned int value, int changedMem, TraceKind kind) {
+    TraceRecord *r = &t->buf[t->cur][t->used++];
+
+    r->pc = pc;
+    r->instr = instr;
+    r->value = value;
+    r->changedMem = changedMem;
+    r->info = (changedReg & 0xff) | kind<<8;
+    if (t->used == TRACE_BUFRECS) {
+        HandOff (t);
+    }
+}
+
+/*
+ *  Write out whatever is buffered and close the trace. Returns 0 if
+ *  everything made it to the file.
+ */
+int CloseTrace (TraceWriter *t) {
+    int error;
+
+    if (t->used > 0) {
+        HandOff (t);
+    }
+    pthread_mutex_lock (&t->lock);
+    t->closing = 1;
+    pthread_cond_broadcast (&t->cond);
+    pthread_mutex_unlock (&t->lock);
+    pthread_join (t->thread, NULL);
+
+    error = t->error;
+    if (fclose (t->file) != 0) {
+        error = 1;
+    }
+    pthread_mutex_destroy (&t->lock);
+    pthread_cond_destroy (&t->cond);
+    free (t->buf[0]);
+    free (t->buf[1]);
+    free (t);
+    return error ? -1 : 0;
+}
@@ -0,0 +1,41 @@
+/*
+ *  Binary trace of a quiet run, one record per instruction, written by
+ *  sim -t and turned back into the usual text output by simtrace.
+ *
+ *  A trace file is a TraceHeader followed by TraceRecords in host byte
+ *  order. Every instruction that completes is a TRACE_STEP record; a run
+ *  that stops on its own ends with one more record saying why, which
+ *  also supplies the "New pc" of the step before it.
+ */
+
+#define TRACE_MAGIC 0x5450494d	/* "MIPT" */
+#define TRACE_VERSION 1
+
+typedef enum {
+    TRACE_STEP=0,	/* instruction completed */
+    TRACE_UNSUPPORTED,	/* stopped on an unsupported instruction */
+    TRACE_MEMORY,	/* lw/sw address fault; changedMem is the address */
+    TRACE_FETCH		/* pc itself was outside of memory */
+} TraceKind;
+
+typedef struct {
+    unsigned int magic;
+    unsigned int version;
+    unsigned int sp;		/* initial $sp */
+    unsigned int layout;	/* Layout the run used; it sets the rest */
+} TraceHeader;
+
+typedef struct {
+    unsigned int pc;
+    unsigned int instr;
+    unsigned int value;		/* new value of changedReg or changedMem */
+    unsigned int changedMem;	/* -1 if none */
+    unsigned int info;		/* changedReg (0xff if none) | kind<<8 */
+} TraceRecord;
+
+typedef struct TraceWriter TraceWriter;
+
+TraceWriter *OpenTrace (const char *path, unsigned int sp, unsigned int layout);
+void TraceStep (TraceWriter*, unsigned int pc, unsigned int instr,
+    int changedReg, unsigned int value, int changedMem, TraceKind kind);
+int CloseTrace (TraceWriter*);
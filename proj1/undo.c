@@ -0,0 +1,397 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "computer.h"
+#include "undo.h"
+#include "loop.h"
+#undef mips			/* gcc already has a def for mips */
+
+/*
+ *  The run is split into stretches of STRETCH instructions. A stretch
+ *  starts with a snapshot of the computer, made with CopyComputer(), and
+ *  then has one record per instruction saying what it overwrote:
+ *
+ *    - the old pc, if it wasn't 4 less than the new one;
+ *    - the old value of the register it wrote, or of HI and LO, or of
+ *      $v0, the heap break and the heap's limit for an sbrk;
+ *    - the address and old value of the memory word it wrote.
+ *
+ *  Values are stored xor'ed with what replaced them, as a variable
+ *  number of 7-bit groups, so a loop counter or a pointer bumped by a
+ *  word costs a byte; a typical instruction takes two or three bytes.
+ *  Records are read back from the end, so each one is written with its
+ *  header last and its groups most significant first, the stop bit on
+ *  the first. Undoing an instruction applies its record to the state
+ *  left behind, which is always the current state.
+ *
+ *  When the records take more than UNDO_BYTES, those of the oldest
+ *  stretches are thrown away but their snapshots kept: going back into
+ *  such a stretch restores its snapshot and runs forward again,
+ *  recording as it goes, to the instruction before. Past MAXSNAPSHOTS
+ *  the oldest stretch goes altogether, and with it that part of the
+ *  history.
+ *
+ *  Each stretch also keeps the numbers read_int read during it, records
+ *  or no records, since they can't be read again. Running forward again
+ *  takes them from there instead of standard input, and prints nothing,
+ *  as the output came out the first time.
+ */
+
+#define STRETCH (1L << 20)	/* instructions per stretch */
+#define UNDO_BYTES (64L << 20)	/* records kept in all */
+#define MAXSNAPSHOTS 64
+
+/* Record header: bits 0-5 are what register changed, 6 and 7 are flags */
+#define REG_HILO 32		/* HI and LO */
+#define REG_BREAK 33		/* $v0, the heap break and the heap's limit */
+#define REG_NONE 63
+#define MEM_CHANGED 0x40
+#define PC_JUMPED 0x80
+
+typedef struct Stretch {
+    Computer snapshot;		/* the computer when the stretch began */
+    long first;			/* its instruction count then */
+    long count;			/* instructions since */
+    unsigned char *bytes;	/* their records, or NULL if thrown away */
+    long used, size;
+    int *inputs;		/* what read_int read, in order */
+    int numInputs, maxInputs;
+    struct Stretch *prev, *next;
+} Stretch;
+
+struct UndoLog {
+    Stretch *oldest, *newest;
+    int numStretches;
+    long totalBytes;		/* in records */
+    Stretch *replaying;		/* the stretch Replay() is running, or NULL */
+    int nextInput;		/* its next read_int */
+    /* What the instruction in progress may overwrite */
+    int pc, hi, lo, reg, word;
+    unsigned int heapBreak, heapLimit;
+};
+
+static Stretch *NewStretch (UndoLog *log, Computer* mips) {
+    Stretch *seg = calloc (1, sizeof(Stretch));
+
+    if (seg == NULL || CopyComputer (&seg->snapshot, mips) < 0) {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+    }
+    seg->first = mips->instrCount;
+    seg->prev = log->newest;
+    if (log->newest != NULL) {
+        log->newest->next = seg;
+    } else {
+        log->oldest = seg;
+    }
+    log->newest = seg;
+    log->numStretches++;
+    return seg;
+}
+
+static void DropRecords (UndoLog *log, Stretch *seg) {
+    log->totalBytes -= seg->size;
+    free (seg->bytes);
+    seg->bytes = NULL;
+    seg->used = seg->size = 0;
+}
+
+static void FreeStretch (UndoLog *log, Stretch *seg) {
+    DropRecords (log, seg);
+    free (seg->inputs);
+    FreeComputer (&seg->snapshot);
+    if (seg->prev != NULL) {
+        seg->prev->next = seg->next;
+    } else {
+        log->oldest = seg->next;
+    }
+    if (seg->next != NULL) {
+        seg->next->prev = seg->prev;
+    } else {
+        log->newest = seg->prev;
+    }
+    log->numStretches--;
+    free (seg);
+}
+
+/* Start recording the computer from where it is now. */
+UndoLog *NewUndoLog (Computer* mips) {
+    UndoLog *log = calloc (1, sizeof(UndoLog));
+
+    if (log == NULL) {
+        return NULL;
+    }
+    NewStretch (log, mips);
+    return log;
+}
+
+void FreeUndoLog (UndoLog *log) {
+    while (log->newest != NULL) {
+        FreeStretch (log, log->newest);
+    }
+    free (log);
+}
+
+/* Whether the instructions being run have been run before */
+int UndoReplaying (UndoLog *log) {
+    return log->replaying != NULL;
+}
+
+/* What read_int read the first time round, while replaying */
+int UndoNextInput (UndoLog *log) {
+    Stretch *seg = log->replaying;
+
+    return log->nextInput < seg->numInputs ? seg->inputs[log->nextInput++] : 0;
+}
+
+/* Remember that read_int just read value */
+void UndoNoteInput (UndoLog *log, int value) {
+    Stretch *seg = log->newest;
+
+    if (seg->numInputs == seg->maxInputs) {
+        seg->maxInputs = seg->maxInputs ? 2*seg->maxInputs : 16;
+        seg->inputs = realloc (seg->inputs, seg->maxInputs * sizeof(int));
+        if (seg->inputs == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+    }
+    seg->inputs[seg->numInputs++] = value;
+}
+
+/* The earliest instruction count the log can go back to */
+long UndoOldest (UndoLog *log) {
+    return log->oldest->first;
+}
+
+static void PutByte (UndoLog *log, Stretch *seg, unsigned char b) {
+    if (seg->used == seg->size) {
+        log->totalBytes -= seg->size;
+        seg->size = seg->size ? 2*seg->size : 4096;
+        seg->bytes = realloc (seg->bytes, seg->size);
+        if (seg->bytes == NULL) {
+            fprintf (stderr, "Out of memory.\n");
+            exit (1);
+        }
+        log->totalBytes += seg->size;
+    }
+    seg->bytes[seg->used++] = b;
+}
+
+static void PutValue (UndoLog *log, Stretch *seg, unsigned int v) {
+    int shift = 28;
+
+    while (shift > 0 && (v >> shift) == 0) {
+        shift -= 7;
+    }
+    PutByte (log, seg, (v >> shift) & 0x7f);
+    for (shift -= 7; shift >= 0; shift -= 7) {
+        PutByte (log, seg, 0x80 | ((v >> shift) & 0x7f));
+    }
+}
+
+static unsigned int GetValue (Stretch *seg) {
+    unsigned int v = 0, b;
+    int shift = 0;
+
+    do {
+        b = seg->bytes[--seg->used];
+        v |= (b & 0x7f) << shift;
+        shift += 7;
+    } while (b & 0x80);
+    return v;
+}
+
+/*
+ *  Note what d, about to run on the computer with register values
+ *  rVals, may overwrite. Called before Execute(), since mult and the
+ *  like change HI and LO there.
+ */
+void UndoBefore (UndoLog *log, Computer* mips, DecodedInstr* d, RegVals* rVals) {
+    int dest = DestReg (d);
+    unsigned int addr;
+
+    if (log->newest->count == STRETCH) {
+        NewStretch (log, mips);
+        if (log->numStretches > MAXSNAPSHOTS) {
+            FreeStretch (log, log->oldest);
+        }
+    }
+    log->pc = mips->pc;
+    log->hi = mips->hi;
+    log->lo = mips->lo;
+    log->reg = dest >= 0 ? mips->registers[dest] : 0;
+    log->heapBreak = mips->heapBreak;
+    log->heapLimit = mips->regions[SEG_HEAP].limit;
+    log->word = 0;
+    if (d->info->mem >= M_SB) {
+        addr = (rVals->R_rs + d->regs.i.addr_or_immed) & ~3;
+        log->word = Fetch (mips, addr);
+    }
+}
+
+/* Record the instruction that just completed, as for PrintInfo(). */
+void UndoAfter (UndoLog *log, Computer* mips, int changedReg, int changedMem) {
+    Stretch *seg = log->newest;
+    int header = changedReg != -1 ? changedReg : REG_NONE;
+
+    if (changedMem != -1) {
+        PutValue (log, seg, changedMem);
+        PutValue (log, seg, log->word ^ Fetch (mips, changedMem));
+        header |= MEM_CHANGED;
+    }
+    if (log->heapBreak != mips->heapBreak
+        || log->heapLimit != mips->regions[SEG_HEAP].limit) {
+        /* sbrk, which also sets $v0 */
+        PutValue (log, seg, log->reg ^ mips->registers[2]);
+        PutValue (log, seg, log->heapBreak ^ mips->heapBreak);
+        PutValue (log, seg, log->heapLimit ^ mips->regions[SEG_HEAP].limit);
+        header = (header & ~REG_NONE) | REG_BREAK;
+    } else if (changedReg != -1) {
+        PutValue (log, seg, log->reg ^ mips->registers[changedReg]);
+    } else if (log->hi != mips->hi || log->lo != mips->lo) {
+        PutValue (log, seg, log->hi ^ mips->hi);
+        PutValue (log, seg, log->lo ^ mips->lo);
+        header = (header & ~REG_NONE) | REG_HILO;
+    }
+    if (mips->pc != log->pc + 4) {
+        PutValue (log, seg, log->pc ^ mips->pc);
+        header |= PC_JUMPED;
+    }
+    PutByte (log, seg, header);
+    seg->count++;
+
+    /* Over budget: forget the records of the oldest stretches */
+    for (seg = log->oldest; log->totalBytes > UNDO_BYTES && seg != log->newest;
+         seg = seg->next) {
+        DropRecords (log, seg);
+    }
+}
+
+/* Make the computer what the stretch's snapshot says, keeping its hooks. */
+static void Restore (Computer* mips, Stretch *seg) {
+    Computer saved = *mips;
+
+    FreeMemory (mips);
+    if (CopyComputer (mips, &seg->snapshot) < 0) {
+        fprintf (stderr, "Out of memory.\n");
+        exit (1);
+    }
+    mips->trace = saved.trace;
+    mips->pipeline = saved.pipeline;
+    mips->ooo = saved.ooo;
+    mips->ilp = saved.ilp;
+    mips->loops = saved.loops;
+    mips->console = saved.console;
+    mips->predictors = saved.predictors;
+    mips->profile = saved.profile;
+    mips->hashes = saved.hashes;
+    mips->undo = saved.undo;
+    mips->breaks = saved.breaks;
+    mips->watches = saved.watches;
+}
+
+/*
+ *  Run n instructions of seg that were run before, on the staged engine
+ *  so they are recorded again, without feeding them to the models a
+ *  second time, printing their output again or reading more input.
+ */
+static void Replay (UndoLog *log, Stretch *seg, Computer* mips, long n) {
+    Computer saved = *mips;
+
+    mips->engine = STAGED;
+    mips->trace = NULL;
+    mips->pipeline = NULL;
+    mips->ooo = NULL;
+    mips->ilp = NULL;
+    mips->loops = NULL;
+    mips->predictors = NULL;
+    mips->profile = NULL;
+    mips->hashes = NULL;
+    mips->breaks = NULL;
+    mips->watches = NULL;
+    log->replaying = seg;
+    log->nextInput = 0;
+    StepN (mips, n);
+    log->replaying = NULL;
+    /* anything after that was read by an instruction now undone */
+    seg->numInputs = log->nextInput;
+    mips->engine = saved.engine;
+    mips->trace = saved.trace;
+    mips->pipeline = saved.pipeline;
+    mips->ooo = saved.ooo;
+    mips->ilp = saved.ilp;
+    mips->loops = saved.loops;
+    mips->predictors = saved.predictors;
+    mips->profile = saved.profile;
+    mips->hashes = saved.hashes;
+    mips->breaks = saved.breaks;
+    mips->watches = saved.watches;
+}
+
+/*
+ *  Take the computer back to before the last instruction it executed.
+ *  A program that stopped is running again afterwards. Returns 0 if the
+ *  log doesn't go back that far.
+ */
+int UndoStep (UndoLog *log, Computer* mips) {
+    Stretch *seg = log->newest;
+    int header, reg;
+    unsigned int addr, value, instr;
+    long target;
+
+    mips->halted = RUNNING;
+    if (mips->loops != NULL) {
+        RestartLoopCheck (mips->loops);
+    }
+    if (seg->count == 0) {
+        /* at the snapshot; the stretch before ends here */
+        if (seg->prev == NULL) {
+            return 0;
+        }
+        FreeStretch (log, seg);
+        seg = log->newest;
+    }
+
+    if (seg->bytes == NULL) {
+        /* Records gone: run forward from the snapshot, recording again */
+        target = seg->first + seg->count - 1;
+        seg->count = 0;
+        Restore (mips, seg);
+        Replay (log, seg, mips, target - mips->instrCount);
+        return 1;
+    }
+
+    header = seg->bytes[--seg->used];
+    reg = header & REG_NONE;
+    if (header & PC_JUMPED) {
+        mips->pc ^= GetValue (seg);
+    } else {
+        mips->pc -= 4;
+    }
+    if (reg == REG_HILO) {
+        mips->lo ^= GetValue (seg);
+        mips->hi ^= GetValue (seg);
+    } else if (reg == REG_BREAK) {
+        mips->regions[SEG_HEAP].limit ^= GetValue (seg);
+        mips->heapBreak ^= GetValue (seg);
+        mips->registers[2] ^= GetValue (seg);
+    } else if (reg != REG_NONE) {
+        mips->registers[reg] ^= GetValue (seg);
+    }
+    if (header & MEM_CHANGED) {
+        value = GetValue (seg);
+        addr = GetValue (seg);
+        WriteWord (mips, addr, Fetch (mips, addr) ^ value);
+        Predecode (mips, addr);
+    }
+    instr = Fetch (mips, mips->pc);
+    if (mips->fullIsa && instr >> 26 == 0 && (instr & 63) == 12
+        && mips->registers[2] == 5 && seg->numInputs > 0) {
+        /* read_int: what it read goes with it */
+        seg->numInputs--;
+    }
+    seg->count--;
+    mips->instrCount--;
+    return 1;
+}
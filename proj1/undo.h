@@ -0,0 +1,17 @@
+/*
+ *  Undo log for going backwards through a run: what each instruction
+ *  overwrote, a few bytes apiece, plus a snapshot of the whole computer
+ *  every so often. Include computer.h first.
+ */
+
+typedef struct UndoLog UndoLog;
+
+UndoLog *NewUndoLog (Computer*);
+void UndoBefore (UndoLog*, Computer*, DecodedInstr*, RegVals*);
+void UndoAfter (UndoLog*, Computer*, int changedReg, int changedMem);
+int UndoStep (UndoLog*, Computer*);
+int UndoReplaying (UndoLog*);
+int UndoNextInput (UndoLog*);
+void UndoNoteInput (UndoLog*, int value);
+long UndoOldest (UndoLog*);
+void FreeUndoLog (UndoLog*);
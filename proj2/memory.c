@@ -8,6 +8,8 @@ unsigned int assoc;
 ReplacementPolicy policy;
 MemorySyncPolicy memory_sync_policy;
 
+static byte DRAM[PHYSICAL_PAGE_COUNT * PHYSICAL_PAGE_SIZE];
+
 
 void init_memory() 
 {
@@ -65,9 +67,35 @@ static int translateAddress(address virtual_addr, address* physical_addr)
   return -1;
 }
 
+/*
+  Copy length bytes into memory starting at addr, all within one page,
+  with one log line rather than one per word.  Used by load_dumpfile().
+ */
+int loadDRAM(address addr, const byte* data, int length)
+{
+  char buffer[200];
+  address phys_addr;
+
+  if(translateAddress(addr, &phys_addr) == -1)
+    return -1;
+  if(length > PHYSICAL_PAGE_SIZE - phys_addr % PHYSICAL_PAGE_SIZE)
+  {
+    append_log("Program does not fit in its page\n");
+    return -1;
+  }
+  memcpy(DRAM + phys_addr, data, length);
+
+  sprintf(buffer, "Loaded %d bytes at 0x%08X\n", length, addr);
+  if(!IS_GUI_ACTIVE())
+    printf(buffer);
+  else
+    append_log(buffer);
+
+  return 0;
+}
+
 int accessDRAM(address addr, byte* data, TransferUnit mode, WriteEnable flag)
 {
-  static byte DRAM[PHYSICAL_PAGE_COUNT * PHYSICAL_PAGE_SIZE];
   static char* reading = "Accessing";
   static char* writing = "Updating";
 #ifdef CYGWIN
@@ -1,6 +1,14 @@
+/* for fileno() and mmap() under -std=c99 */
+#define _DEFAULT_SOURCE
+
 #include "tips.h"
 #include "util.h"
 #include <netinet/in.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <tmmintrin.h>
+#endif
 
 char* program_name;
 CacheView view;
@@ -38,12 +46,20 @@ void validate_cache_parameters(int set_count_value, int assoc_value, int block_s
     block_size = 0;
 }
 
+/*
+  Load a dump file into the program page.  The file is mapped rather
+  than read a word at a time, its words are byte-swapped in bulk, and the
+  whole image goes into memory in one loadDRAM() call.
+ */
 int load_dumpfile(const char* filename)
 {
+  static instruction image[PHYSICAL_PAGE_SIZE / sizeof(instruction)];
   char buffer[200];
   FILE* dumpfile;
-  int i;
-  byte* inst = (byte*)(malloc(sizeof(byte) * sizeof(instruction)));
+  struct stat st;
+  void* mapped = MAP_FAILED;
+  instruction extra;
+  int count, limit = PHYSICAL_PAGE_SIZE / sizeof(instruction) - 1;
 
   /* Read in file */
   if(!(dumpfile = fopen(filename, "rb")))
@@ -52,26 +68,46 @@ int load_dumpfile(const char* filename)
     append_log(buffer);
     return -1;
   }
-  else
+
+  /* Map it if we can, else read it; it has to fit in a page, less one
+     word for the sentinel.  count is -1 if it doesn't. */
+  count = 0;
+  if(fstat(fileno(dumpfile), &st) == 0 && S_ISREG(st.st_mode) && st.st_size >= sizeof(instruction))
+  {
+    if(st.st_size / sizeof(instruction) > limit)
+      count = -1;
+    else
+      mapped = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(dumpfile), 0);
+  }
+  if(mapped != MAP_FAILED)
   {
-    sprintf(buffer, "[%s] loaded\n", filename);
+    count = st.st_size / sizeof(instruction);
+    reverse_words(image, (const instruction*) mapped, count);
+    munmap(mapped, st.st_size);
+  }
+  else if(count == 0)
+  {
+    count = fread(image, sizeof(instruction), limit, dumpfile);
+    if(count == limit && fread(&extra, sizeof(instruction), 1, dumpfile) == 1)
+      count = -1;
+    else
+      reverse_words(image, image, count);
+  }
+  if(count < 0)
+  {
+    sprintf(buffer, "Unable to load [%s]: more than %d instructions\n", filename, limit);
     append_log(buffer);
+    fclose(dumpfile);
+    return -1;
   }
+  sprintf(buffer, "[%s] loaded\n", filename);
+  append_log(buffer);
 
-  /* Load instructions into memory */
-  for(i = 0; i < PHYSICAL_PAGE_SIZE && fread(inst, sizeof(instruction), 1, dumpfile); i += sizeof(instruction))
-  {
-    /* sprintf(buffer, "%02x , %08x\n", *inst, ntohl(*((word*)inst))); */
-    reverse_endianness( (instruction*) inst );
-    accessDRAM(PROGRAM_START + i, inst, WORD_SIZE, WRITE);
-  }  
-  
   /* Insert sentinel instruction */
-  *((word*)inst) = 0xffffffff;
-  accessDRAM(PROGRAM_START + i, inst, WORD_SIZE, WRITE);
+  image[count] = 0xffffffff;
+  loadDRAM(PROGRAM_START, (byte*) image, (count + 1) * sizeof(instruction));
 
   fclose(dumpfile);
-  free(inst);
 
   /* Initialize processor */
   reinit_processor();
@@ -88,6 +124,40 @@ void reverse_endianness(instruction* word)
   *word = w;
 }
 
+#if defined(__x86_64__) || defined(__i386__)
+/* Four words per pshufb, for CPUs with SSSE3 */
+__attribute__((target("ssse3")))
+static int reverse_words_ssse3(instruction* dst, const instruction* src, int count)
+{
+  const __m128i swap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  int i;
+
+  for(i = 0; i + 4 <= count; i += 4)
+    _mm_storeu_si128((__m128i*) (dst + i),
+                     _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*) (src + i)), swap));
+  return i;
+}
+#endif
+
+/*
+  Copy count words from src to dst reversing the bytes of each, as
+  reverse_endianness() does.  dst may be src.
+ */
+void reverse_words(instruction* dst, const instruction* src, int count)
+{
+  int i = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+  if(__builtin_cpu_supports("ssse3"))
+    i = reverse_words_ssse3(dst, src, count);
+#endif
+  for(; i < count; i++)
+  {
+    dst[i] = src[i];
+    reverse_endianness(dst + i);
+  }
+}
+
 int main(int argc, char** argv)
 {
   program_name = argv[0];
@@ -173,10 +173,12 @@ void highlight_offset(unsigned int set_num, unsigned int assoc_num, unsigned int
 /* Defined in tips.c */
 int load_dumpfile(const char* filename);
 void reverse_endianness(instruction* word);
+void reverse_words(instruction* dst, const instruction* src, int count);
 
 /* Defined in memory.c */
 void init_memory(void);
 void flush_cache(void);
+int loadDRAM(address addr, const byte* data, int length);
 
 /* Defined in cpu.c */
 void reinit_processor(void);